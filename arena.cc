@@ -0,0 +1,145 @@
+#include "arena.h"
+#include "config.h"
+
+// Constructor
+Arena::Arena() {
+    this->allocPtr = nullptr;
+    this->allocRemaining = 0;
+    this->memoryUsage = 0;
+}
+
+// Destructor
+Arena::~Arena() {
+    this->reset();
+}
+
+// Allocate bytes without alignment
+char* Arena::allocate(size_t bytes) {
+    // Take the bytes from the current block if possible
+    if (bytes <= this->allocRemaining) {
+        char* result = this->allocPtr;
+        this->allocPtr += bytes;
+        this->allocRemaining -= bytes;
+        return result;
+    }
+    return this->allocateFallback(bytes);
+}
+
+// Allocate bytes aligned for pointers
+char* Arena::allocateAligned(size_t bytes) {
+    const size_t align = alignof(void*);
+    size_t mod = reinterpret_cast<uintptr_t>(this->allocPtr) & (align - 1);
+    size_t slop = (mod == 0 ? 0 : align - mod);
+    size_t needed = bytes + slop;
+
+    // Skip the slop in the current block if possible
+    if (needed <= this->allocRemaining) {
+        char* result = this->allocPtr + slop;
+        this->allocPtr += needed;
+        this->allocRemaining -= needed;
+        return result;
+    }
+
+    // A new block is always aligned
+    return this->allocateFallback(bytes);
+}
+
+// Allocate when the current block is not enough
+char* Arena::allocateFallback(size_t bytes) {
+    // Give a large object its own block to avoid wasting the current one
+    if (bytes > arena_blockSize / 4) {
+        return this->allocateNewBlock(bytes);
+    }
+
+    // Waste the rest of the current block and start a new one
+    this->allocPtr = this->allocateNewBlock(arena_blockSize);
+    this->allocRemaining = arena_blockSize;
+
+    char* result = this->allocPtr;
+    this->allocPtr += bytes;
+    this->allocRemaining -= bytes;
+    return result;
+}
+
+// Allocate a new block
+char* Arena::allocateNewBlock(size_t blockBytes) {
+    char* result = new char[blockBytes];
+    this->blocks.push_back(result);
+    this->memoryUsage += blockBytes;
+    return result;
+}
+
+// Release all the blocks
+void Arena::reset() {
+    for (auto block : this->blocks) {
+        delete[] block;
+    }
+    this->blocks.clear();
+
+    this->allocPtr = nullptr;
+    this->allocRemaining = 0;
+    this->memoryUsage = 0;
+}
+
+// Destructor
+ConcurrentArena::~ConcurrentArena() {
+    this->reset();
+}
+
+// Start a new block once the current one is used up
+void ConcurrentArena::newBlock(Block* full) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+
+    // Another writer started one meanwhile
+    if (this->current.load(std::memory_order_acquire) != full)
+        return;
+
+    Block* block = new Block();
+    block->used.store(0, std::memory_order_relaxed);
+    block->size = arena_blockSize;
+    block->data = new char[arena_blockSize];
+    this->blocks.push_back(block);
+    this->memoryUsage.fetch_add(arena_blockSize, std::memory_order_relaxed);
+    this->current.store(block, std::memory_order_release);
+}
+
+// Allocate bytes aligned for pointers
+char* ConcurrentArena::allocate(size_t bytes) {
+    const size_t align = alignof(void*);
+    bytes = (bytes + align - 1) & ~(align - 1);
+
+    // Give a large object its own block to avoid wasting the current one
+    if (bytes > arena_blockSize / 4) {
+        char* result = new char[bytes];
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->largeObjects.push_back(result);
+        this->memoryUsage.fetch_add(bytes, std::memory_order_relaxed);
+        return result;
+    }
+
+    while (true) {
+        Block* block = this->current.load(std::memory_order_acquire);
+        if (block != nullptr) {
+            // The bytes past the end of a full block are wasted, the writers move on to a new one
+            size_t offset = block->used.fetch_add(bytes, std::memory_order_relaxed);
+            if (offset + bytes <= block->size)
+                return block->data + offset;
+        }
+        this->newBlock(block);
+    }
+}
+
+// Release all the blocks
+void ConcurrentArena::reset() {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    for (Block* block : this->blocks) {
+        delete[] block->data;
+        delete block;
+    }
+    for (char* object : this->largeObjects)
+        delete[] object;
+    this->blocks.clear();
+    this->largeObjects.clear();
+    this->current.store(nullptr, std::memory_order_relaxed);
+    this->memoryUsage.store(0, std::memory_order_relaxed);
+}
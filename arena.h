@@ -0,0 +1,77 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <mutex>
+#include <atomic>
+
+// Bump allocator of the memtable
+// Memory is handed out from large blocks and released all at once
+class Arena {
+private:
+    // Current block
+    char* allocPtr;
+    size_t allocRemaining;
+
+    // All the blocks allocated
+    std::vector<char*> blocks;
+    size_t memoryUsage;
+
+    // Allocate when the current block is not enough
+    char* allocateFallback(size_t bytes);
+    char* allocateNewBlock(size_t blockBytes);
+
+public:
+    Arena();
+    ~Arena();
+
+    // Allocate bytes without alignment, e.g. for keys and values
+    char* allocate(size_t bytes);
+    // Allocate bytes aligned for pointers, e.g. for nodes
+    char* allocateAligned(size_t bytes);
+
+    // Release all the blocks
+    void reset();
+
+    // Get the bytes held by the arena
+    size_t getMemoryUsage(){return memoryUsage;};
+};
+
+// Arena shared by the writers of a concurrent skiplist
+// The writers take their bytes from the current block with one atomic add,
+// the lock is only held to start a new block or give a large object its own
+class ConcurrentArena {
+private:
+    // Block with the bytes already handed out in front
+    struct Block {
+        std::atomic<size_t> used;
+        size_t size;
+        char* data;
+    };
+
+    // Block the writers bump through, nullptr before the first allocation
+    std::atomic<Block*> current;
+    // All the blocks and the large objects, guarded by the mutex
+    std::vector<Block*> blocks;
+    std::vector<char*> largeObjects;
+    std::mutex mutex;
+    std::atomic<size_t> memoryUsage;
+
+    // Start a new block once the current one is used up
+    void newBlock(Block* full);
+
+public:
+    ConcurrentArena() : current(nullptr), memoryUsage(0) {};
+    ~ConcurrentArena();
+
+    // Same as Arena, safe to call from several threads
+    // Every allocation is rounded up to the pointer alignment, so both are aligned
+    char* allocate(size_t bytes);
+    char* allocateAligned(size_t bytes){return this->allocate(bytes);};
+
+    // Release all the blocks, no thread may be allocating
+    void reset();
+
+    // Get the bytes held by the arena
+    size_t getMemoryUsage(){return memoryUsage.load(std::memory_order_relaxed);};
+};
@@ -0,0 +1,143 @@
+#include "../bloomfilter.h"
+#include "../blockedbloomfilter.h"
+#include "../xorfilter.h"
+#include "../config.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+/****************************************************************
+    False positive rate and probe throughput of the sstable filters
+    bloom:   BloomFilter, 4 probes over the whole filter
+    blocked: BlockedBloomFilter with the scalar probe
+    simd:    BlockedBloomFilter with the AVX2 probe
+    The blocked filter gets the same memory as the bloom filter,
+    or [bits per key] if given
+    Then build time, memory and query latency of the bloom filter,
+    the blocked filter at sstable_filter_bits_per_key and the xor
+    filter, from sstable sized key sets up
+    usage: filter_bench [probe num] [bits per key]
+****************************************************************/
+
+// Time the probes, return the positive count and probes per second
+template <typename F>
+double run(F &filter, const std::vector<uint64_t> &probes, uint64_t &positive){
+    positive = 0;
+    auto start = std::chrono::steady_clock::now();
+    for(uint64_t key : probes)
+        positive += filter.find(key);
+    auto end = std::chrono::steady_clock::now();
+    return probes.size() / std::chrono::duration<double>(end - start).count();
+}
+
+// Build the filter of the keys rounds times, print the costs of the last one
+template <typename F, typename Make>
+void measure(const char* name, Make make, const std::vector<uint64_t> &keys,
+             const std::vector<uint64_t> &probes, uint64_t rounds){
+    F* filter = nullptr;
+    auto start = std::chrono::steady_clock::now();
+    for(uint64_t i = 0; i < rounds; i++){
+        delete filter;
+        filter = make();
+        for(uint64_t key : keys)
+            filter->insert(key);
+        filter->build();
+    }
+    auto end = std::chrono::steady_clock::now();
+    double buildMicros = std::chrono::duration<double, std::micro>(end - start).count() / rounds;
+
+    uint64_t positive;
+    double rate = run(*filter, probes, positive);
+    std::printf("%8lu %8s %12.1f %10lu %10.2f %9.4f%% %10.1f\n", keys.size(), name, buildMicros,
+        filter->getMemoryUsage(), filter->getMemoryUsage() * 8.0 / keys.size(),
+        100.0 * positive / probes.size(), 1e9 / rate);
+    delete filter;
+}
+
+// The bloom filters are ready after the inserts
+template <typename K, size_t Size>
+struct BenchBloom : public BloomFilter<K, Size> {
+    void build(){};
+    uint64_t getMemoryUsage(){return Size;};
+};
+
+template <typename K>
+struct BenchBlocked : public BlockedBloomFilter<K> {
+    BenchBlocked(uint64_t keyNum, double bitsPerKey) : BlockedBloomFilter<K>(keyNum, bitsPerKey){};
+    void build(){};
+};
+
+int main(int argc, char** argv){
+    uint64_t probeNum = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+    double fixedBitsPerKey = (argc > 2) ? std::strtod(argv[2], nullptr) : 0;
+
+    std::printf("filter size %d bytes, avx2 %s\n", sstable_bfSize,
+        BlockedBloomFilter<uint64_t>::useSIMD ? "yes" : "no");
+    std::printf("%8s %10s %10s %10s %12s %12s %12s\n",
+        "keys", "bloom fpr", "blk fpr", "simd fpr", "bloom/s", "blocked/s", "simd/s");
+
+    bool hasSIMD = BlockedBloomFilter<uint64_t>::useSIMD;
+    std::mt19937_64 generator(42);
+
+    for(uint64_t keyNum : {500, 1000, 2000, 4000, 8000}){
+        // Even keys are inserted, odd keys are probed so that every positive is false
+        BloomFilter<uint64_t, sstable_bfSize>* bloom = new BloomFilter<uint64_t, sstable_bfSize>();
+        double bitsPerKey = fixedBitsPerKey > 0 ? fixedBitsPerKey : sstable_bfSize * 8.0 / keyNum;
+        BlockedBloomFilter<uint64_t>* blocked = new BlockedBloomFilter<uint64_t>(keyNum, bitsPerKey);
+        for(uint64_t i = 0; i < keyNum; i++){
+            uint64_t key = generator() & ~1ULL;
+            bloom->insert(key);
+            blocked->insert(key);
+        }
+
+        std::vector<uint64_t> probes(probeNum);
+        for(uint64_t &key : probes)
+            key = generator() | 1ULL;
+
+        uint64_t bloomPositive, blockedPositive, simdPositive = 0;
+        double bloomRate = run(*bloom, probes, bloomPositive);
+
+        BlockedBloomFilter<uint64_t>::useSIMD = false;
+        double blockedRate = run(*blocked, probes, blockedPositive);
+
+        double simdRate = 0;
+        if(hasSIMD){
+            BlockedBloomFilter<uint64_t>::useSIMD = true;
+            simdRate = run(*blocked, probes, simdPositive);
+            // Both probes must agree on every key
+            if(simdPositive != blockedPositive)
+                std::printf("simd and scalar probes disagree\n");
+        }
+
+        std::printf("%8lu %9.4f%% %9.4f%% %9.4f%% %12.0f %12.0f %12.0f\n", keyNum,
+            100.0 * bloomPositive / probeNum, 100.0 * blockedPositive / probeNum,
+            100.0 * simdPositive / probeNum, bloomRate, blockedRate, simdRate);
+
+        delete bloom;
+        delete blocked;
+    }
+
+    std::printf("\n%8s %8s %12s %10s %10s %10s %10s\n",
+        "keys", "filter", "build us", "bytes", "bits/key", "fpr", "query ns");
+
+    for(uint64_t keyNum : {8, 64, 512, 4000}){
+        std::vector<uint64_t> keys(keyNum);
+        for(uint64_t &key : keys)
+            key = generator() & ~1ULL;
+        std::vector<uint64_t> probes(probeNum);
+        for(uint64_t &key : probes)
+            key = generator() | 1ULL;
+
+        uint64_t rounds = std::max<uint64_t>(1, 100000 / keyNum);
+        measure<BenchBloom<uint64_t, sstable_bfSize> >("bloom",
+            []{ return new BenchBloom<uint64_t, sstable_bfSize>(); }, keys, probes, rounds);
+        measure<BenchBlocked<uint64_t> >("blocked",
+            [keyNum]{ return new BenchBlocked<uint64_t>(keyNum, sstable_filter_bits_per_key); }, keys, probes, rounds);
+        measure<XorFilter<uint64_t> >("xor",
+            [keyNum]{ return new XorFilter<uint64_t>(keyNum); }, keys, probes, rounds);
+    }
+    return 0;
+}
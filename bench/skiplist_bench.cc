@@ -0,0 +1,83 @@
+#include "../skiplist.h"
+#include "../concurrent_skiplist.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+/****************************************************************
+    Multi-threaded insert benchmark
+    Skiplist is shared behind one mutex, the way the store used
+    it, ConcurrentSkiplist is inserted into without any lock
+    usage: skiplist_bench [keys per thread] [value size]
+****************************************************************/
+
+// Keys of each thread, drawn up front so that only the inserts are timed
+std::vector<std::vector<uint64_t>> makeKeys(int threadNum, uint64_t keyNum){
+    std::vector<std::vector<uint64_t>> keys(threadNum);
+    for(int t = 0; t < threadNum; t++){
+        std::mt19937_64 generator(t + 1);
+        for(uint64_t i = 0; i < keyNum; i++)
+            keys[t].push_back(generator());
+    }
+    return keys;
+}
+
+// Run the insert function on every thread, return inserts per second
+template <typename F>
+double run(int threadNum, uint64_t keyNum, F insert){
+    std::vector<std::vector<uint64_t>> keys = makeKeys(threadNum, keyNum);
+    std::vector<std::thread> threads;
+
+    auto start = std::chrono::steady_clock::now();
+    for(int t = 0; t < threadNum; t++){
+        threads.push_back(std::thread([&, t]{
+            for(uint64_t key : keys[t])
+                insert(key, t);
+        }));
+    }
+    for(auto &thread : threads)
+        thread.join();
+    auto end = std::chrono::steady_clock::now();
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    return threadNum * keyNum / seconds;
+}
+
+int main(int argc, char** argv){
+    uint64_t keyNum = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 200000;
+    size_t valueSize = (argc > 2) ? std::strtoull(argv[2], nullptr, 10) : 32;
+    std::string value(valueSize, 'v');
+
+    std::printf("%-8s %16s %16s %8s\n", "threads", "Skiplist+mutex", "Concurrent", "speedup");
+
+    for(int threadNum : {1, 2, 4, 8}){
+        double lockedOps, concurrentOps;
+        {
+            Skiplist<uint64_t, std::string> list;
+            std::mutex mutex;
+            lockedOps = run(threadNum, keyNum, [&](uint64_t key, int){
+                std::lock_guard<std::mutex> lock(mutex);
+                list.insert(key, value);
+            });
+        }
+        {
+            ConcurrentSkiplist<uint64_t, std::string> list;
+            std::vector<uint64_t> versions(threadNum, 0);
+            concurrentOps = run(threadNum, keyNum, [&](uint64_t key, int t){
+                list.insert(key, value, ++versions[t]);
+            });
+            if(list.getSize() > threadNum * keyNum){
+                std::printf("size mismatch\n");
+                return 1;
+            }
+        }
+        std::printf("%-8d %14.0f/s %14.0f/s %7.2fx\n", threadNum, lockedOps, concurrentOps, concurrentOps / lockedOps);
+    }
+    return 0;
+}
@@ -0,0 +1,89 @@
+#include "../vLog.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <list>
+#include <random>
+#include <string>
+#include <vector>
+
+/****************************************************************
+    Random value reads from the vLog
+    stream: an ifstream opened per read, as vLog used to do
+    pread:  vlog_read_pread
+    mmap:   vlog_read_mmap
+    usage: vlog_bench [value num] [value size] [read num]
+****************************************************************/
+
+const char* benchPath = "./vlog_bench.data";
+
+// Read a value the way vLog did before it kept a descriptor
+std::string streamRead(uint64_t offset, uint32_t length){
+    std::ifstream inFile(benchPath, std::ios::in | std::ios::binary);
+    inFile.seekg(0, std::ios::end);
+    size_t fileSize = inFile.tellg();
+    if(offset + length > fileSize)
+        return "";
+    inFile.seekg(offset, std::ios::beg);
+    std::string res(length, '\0');
+    inFile.read(&res[0], length);
+    return res;
+}
+
+// Time the reads, return reads per second
+double run(const std::vector<uint64_t> &offsets, uint32_t length, std::function<std::string(uint64_t, uint32_t)> read){
+    uint64_t checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for(uint64_t offset : offsets)
+        checksum += read(offset, length)[0];
+    auto end = std::chrono::steady_clock::now();
+
+    // Keep the reads from being optimized away
+    if(checksum == 1)
+        std::printf(" ");
+    return offsets.size() / std::chrono::duration<double>(end - start).count();
+}
+
+int main(int argc, char** argv){
+    uint64_t valueNum = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 100000;
+    uint32_t valueSize = (argc > 2) ? std::strtoul(argv[2], nullptr, 10) : 128;
+    uint64_t readNum = (argc > 3) ? std::strtoull(argv[3], nullptr, 10) : 200000;
+
+    // Build the vLog
+    std::remove(benchPath);
+    {
+        vLog writer(benchPath);
+        std::list<std::pair<uint64_t, std::string>> list;
+        for(uint64_t i = 0; i < valueNum; i++)
+            list.push_back({i + 1, std::string(valueSize, 'a' + i % 26)});
+        writer.readFromList(list);
+        writer.writeToFile();
+    }
+
+    // Offsets of random values: Magic(1Byte) + Checksum(2Byte) + Key(8Byte) + vlen(4Byte) + Value
+    std::mt19937_64 generator(1);
+    std::vector<uint64_t> offsets;
+    for(uint64_t i = 0; i < readNum; i++)
+        offsets.push_back((generator() % valueNum) * (15 + valueSize) + 15);
+
+    vLog preadLog(benchPath, vlog_read_pread);
+    vLog mmapLog(benchPath, vlog_read_mmap);
+
+    // Warm the page cache so that all the modes read from memory
+    run(offsets, valueSize, [&](uint64_t offset, uint32_t length){ return preadLog.getValFromFile(offset, length); });
+
+    double streamOps = run(offsets, valueSize, streamRead);
+    double preadOps = run(offsets, valueSize, [&](uint64_t offset, uint32_t length){ return preadLog.getValFromFile(offset, length); });
+    double mmapOps = run(offsets, valueSize, [&](uint64_t offset, uint32_t length){ return mmapLog.getValFromFile(offset, length); });
+
+    std::printf("%-8s %14s %10s\n", "mode", "reads/s", "vs stream");
+    std::printf("%-8s %12.0f/s %9.2fx\n", "stream", streamOps, 1.0);
+    std::printf("%-8s %12.0f/s %9.2fx\n", "pread", preadOps, preadOps / streamOps);
+    std::printf("%-8s %12.0f/s %9.2fx\n", "mmap", mmapOps, mmapOps / streamOps);
+
+    std::remove(benchPath);
+    return 0;
+}
@@ -0,0 +1,284 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include "MurmurHash3.h"
+#include "keyhash.h"
+#include "config.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+/****************************************************************
+    Blocked Bloom filter: all the probes of a key land in one
+    64-byte block, i.e. one cache line
+    Probe i of a key sets the bit given by the top 9 bits of the
+    double hashing probe h1 + i * h2, anywhere in the 512 bits
+    The number of blocks follows the keys and the bits per key,
+    the number of probes is the optimal one for the bits per key
+
+    File: Magic(4Byte) + Format(1Byte) + Probes(1Byte)
+          + Flags(2Byte) + Blocks(8Byte) + Blocks * 64Byte
+    Filters without blocked_flag_packed come from the fixed-size
+    layout, they are padded up to sstable_bfSize and let every key
+    through
+****************************************************************/
+
+template <typename K>
+class BlockedBloomFilter {
+private:
+    static const size_t headerSize = 16;
+    static const size_t blockWords = 16;
+    static const size_t maxProbes = 8;
+    // The filter is followed directly by the index
+    static const uint16_t blocked_flag_packed = 1;
+
+    // One cache line
+    struct alignas(64) Block {
+        uint32_t words[blockWords];
+    };
+
+    // Blocks of the filter, aligned to the cache line
+    std::vector<Block> blocks;
+    // Bits set by each key, 0 lets every key through
+    uint8_t probes = maxProbes;
+    // Bytes of the filter in the file
+    uint64_t fileSize = 0;
+
+    // Block of a key
+    uint64_t getBlock(const KeyHash &keyHash);
+
+    bool findScalar(const KeyHash &keyHash);
+    bool findSIMD(const KeyHash &keyHash);
+
+public:
+    // Use the AVX2 probe if the cpu supports it, can be turned off to compare
+    static bool useSIMD;
+
+    // Insert a key into the bloom filter
+    void insert(K key);
+    // Check if a key is in the bloom filter
+    bool find(K key);
+    bool find(const KeyHash &keyHash);
+
+    // Load the bloom filter from a file
+    int readFile(std::string path, uint64_t offset);
+    // Save the bloom filter to a file
+    uint64_t writeToFile(std::string path, uint64_t offset);
+
+    // Bytes of the filter in the file, header included
+    uint64_t getFileSize(){return fileSize;};
+    // Bytes of the filter in memory
+    uint64_t getMemoryUsage(){return blocks.size() * sizeof(Block);};
+
+    // Constructor, sized for keyNum keys
+    BlockedBloomFilter(uint64_t keyNum, double bitsPerKey);
+    BlockedBloomFilter(std::string path, uint64_t offset);
+    // Destructor
+    ~BlockedBloomFilter(){};
+};
+
+template <typename K>
+bool BlockedBloomFilter<K>::useSIMD =
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_supports("avx2");
+#else
+    false;
+#endif
+
+// Constructor, sized for keyNum keys
+template <typename K>
+BlockedBloomFilter<K>::BlockedBloomFilter(uint64_t keyNum, double bitsPerKey) {
+    // At least one block, a block holds 512 bits
+    uint64_t blockNum = std::max<uint64_t>(1, std::ceil(keyNum * bitsPerKey / (blockWords * 32)));
+    blocks.assign(blockNum, Block());
+    memset(blocks.data(), 0, blocks.size() * sizeof(Block));
+
+    // k = bits per key * ln2 is optimal, the AVX2 probe has 8 lanes
+    probes = std::min<long>(maxProbes, std::max<long>(1, std::lround(bitsPerKey * 0.69314718)));
+    fileSize = headerSize + blocks.size() * sizeof(Block);
+}
+
+// Parameterized constructor
+template <typename K>
+BlockedBloomFilter<K>::BlockedBloomFilter(std::string path, uint64_t offset) {
+    readFile(path, offset);
+}
+
+// Block of a key
+template <typename K>
+uint64_t BlockedBloomFilter<K>::getBlock(const KeyHash &keyHash) {
+    // Map the high half of the first word onto the blocks without a division
+    return ((keyHash.hash[0] >> 32) * blocks.size()) >> 32;
+}
+
+// Insert a key into the bloom filter
+template <typename K>
+void BlockedBloomFilter<K>::insert(K key) {
+    KeyHash keyHash(key);
+    uint32_t* words = blocks[getBlock(keyHash)].words;
+
+    for (int i = 0; i < probes; i++) {
+        uint32_t bit = keyHash.probe(i) >> 23;
+        words[bit >> 5] |= 1U << (bit & 31);
+    }
+}
+
+// Check the probes one by one
+template <typename K>
+bool BlockedBloomFilter<K>::findScalar(const KeyHash &keyHash) {
+    const uint32_t* words = blocks[getBlock(keyHash)].words;
+
+    for (int i = 0; i < probes; i++) {
+        uint32_t bit = keyHash.probe(i) >> 23;
+        if ((words[bit >> 5] & (1U << (bit & 31))) == 0)
+            return false;
+    }
+    return true;
+}
+
+// Check the probes with one mask compare, a probe per lane
+#if defined(__x86_64__) || defined(__i386__)
+template <typename K>
+__attribute__((target("avx2")))
+bool BlockedBloomFilter<K>::findSIMD(const KeyHash &keyHash) {
+    const uint32_t* block = blocks[getBlock(keyHash)].words;
+
+    // The bit of each lane, the top 9 bits of h1 + i * h2
+    __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i probe = _mm256_add_epi32(_mm256_set1_epi32(keyHash.h1()),
+        _mm256_mullo_epi32(_mm256_set1_epi32(keyHash.h2()), lane));
+    __m256i bit = _mm256_srli_epi32(probe, 23);
+    __m256i word = _mm256_srli_epi32(bit, 5);
+    __m256i mask = _mm256_sllv_epi32(_mm256_set1_epi32(1), _mm256_and_si256(bit, _mm256_set1_epi32(31)));
+
+    // Lanes past the probes of the filter check nothing
+    mask = _mm256_and_si256(mask, _mm256_cmpgt_epi32(_mm256_set1_epi32(probes), lane));
+
+    // Gather the word of each lane from the two halves of the block
+    __m256i low = _mm256_permutevar8x32_epi32(_mm256_load_si256(reinterpret_cast<const __m256i*>(block)), word);
+    __m256i high = _mm256_permutevar8x32_epi32(_mm256_load_si256(reinterpret_cast<const __m256i*>(block + 8)), word);
+    __m256i useHigh = _mm256_cmpgt_epi32(word, _mm256_set1_epi32(7));
+    __m256i words = _mm256_blendv_epi8(low, high, useHigh);
+
+    // All the bits of the mask are set in the words
+    return _mm256_testc_si256(words, mask);
+}
+#else
+template <typename K>
+bool BlockedBloomFilter<K>::findSIMD(const KeyHash &keyHash) {
+    return findScalar(keyHash);
+}
+#endif
+
+// Check if a key is in the bloom filter
+template <typename K>
+bool BlockedBloomFilter<K>::find(K key) {
+    return find(KeyHash(key));
+}
+
+// Check a key hashed by the caller
+template <typename K>
+bool BlockedBloomFilter<K>::find(const KeyHash &keyHash) {
+    // An unreadable filter lets every key through
+    if (blocks.empty() || probes == 0)
+        return true;
+    if (useSIMD)
+        return findSIMD(keyHash);
+    return findScalar(keyHash);
+}
+
+// Load the bloom filter from a file
+template <typename K>
+int BlockedBloomFilter<K>::readFile(std::string path, uint64_t offset) {
+    std::ifstream inFile(path, std::ios::in | std::ios::binary);
+    // Return -1 if the file cannot be opened
+    if (!inFile)
+        return -1;
+
+    inFile.seekg(0, std::ios::end);
+    uint64_t fileLimit = inFile.tellg();
+
+    // Return -2 if the header is out of bounds
+    if (offset + headerSize > fileLimit) {
+        inFile.close();
+        return -2;
+    }
+
+    // Skip the magic and the format, they were checked by the caller
+    uint16_t flags = 0;
+    uint64_t blockNum = 0;
+    inFile.seekg(offset + 5, std::ios::beg);
+    inFile.read((char*)&probes, sizeof(probes));
+    inFile.read((char*)&flags, sizeof(flags));
+    inFile.read((char*)&blockNum, sizeof(blockNum));
+
+    // Return -3 if the blocks are out of bounds
+    if (offset + headerSize + blockNum * sizeof(Block) > fileLimit) {
+        inFile.close();
+        return -3;
+    }
+
+    blocks.resize(blockNum);
+    inFile.read((char*)blocks.data(), blockNum * sizeof(Block));
+    inFile.close();
+
+    if (flags & blocked_flag_packed)
+        fileSize = headerSize + blockNum * sizeof(Block);
+    else {
+        // The bits of the fixed-size layout were set another way
+        fileSize = sstable_bfSize;
+        probes = 0;
+    }
+    return 0;
+}
+
+// Save the bloom filter to a file
+template <typename K>
+uint64_t BlockedBloomFilter<K>::writeToFile(std::string path, uint64_t offset) {
+    bool isFileExists = false;
+    std::ifstream inFile(path, std::ios::in | std::ios::binary);
+
+    if (inFile) {
+        isFileExists = true;
+        inFile.close();
+    }
+
+    if (!isFileExists) {
+        offset = 0;
+        // Create a new file
+        std::fstream createFile(path, std::ios::out | std::ios::binary);
+        createFile.close();
+    }
+
+    std::fstream outFile(path, std::ios::out | std::ios::in | std::ios::binary);
+
+    // Return -1 if the file cannot be opened
+    if (!outFile)
+        return -1;
+
+    // Magic(4Byte) + Format(1Byte) + Probes(1Byte) + Flags(2Byte) + Blocks(8Byte)
+    char header[headerSize] = {0};
+    uint32_t magic = sstable_filter_magic;
+    uint8_t format = sstable_filter_blocked;
+    uint16_t flags = blocked_flag_packed;
+    uint64_t blockNum = blocks.size();
+    memcpy(header, &magic, sizeof(magic));
+    memcpy(header + 4, &format, sizeof(format));
+    memcpy(header + 5, &probes, sizeof(probes));
+    memcpy(header + 6, &flags, sizeof(flags));
+    memcpy(header + 8, &blockNum, sizeof(blockNum));
+
+    outFile.seekp(offset, std::ios::beg);
+    outFile.write(header, headerSize);
+    outFile.write((char*)blocks.data(), blocks.size() * sizeof(Block));
+    outFile.close();
+
+    fileSize = headerSize + blocks.size() * sizeof(Block);
+    return offset;
+}
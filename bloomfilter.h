@@ -5,6 +5,7 @@
 #include <iostream>
 #include <fstream>
 #include "MurmurHash3.h"
+#include "keyhash.h"
 
 template <typename K, size_t Size>
 class BloomFilter {
@@ -17,6 +18,7 @@ public:
     void insert(K key);
     // Check if a key is in the bloom filter
     bool find(K key);
+    bool find(const KeyHash &keyHash);
 
     // Load the bloom filter from a file
     int readFile(std::string path, uint64_t offset);
@@ -39,27 +41,29 @@ BloomFilter<K, Size>::BloomFilter(std::string path, uint64_t offset) {
 // Insert a key into the bloom filter
 template <typename K, size_t Size>
 void BloomFilter<K, Size>::insert(K key) {
-    // Hash the key
-    uint64_t hash[4];
-    MurmurHash3_x64_128(&key, sizeof(K), 0, hash);
-    this->bloomfilterData.set(0, 1);
+    // Hash the key, the 128-bit hash is split into four 32-bit hashes
+    KeyHash keyHash(key);
 
     // Insert the key into the bloom filter
     for (int i = 0; i < 4; i++) {
-        bloomfilterData[hash[i] % (Size * 8)] = 1;
+        uint32_t curHash = keyHash.hash[i / 2] >> (32 * (i % 2));
+        bloomfilterData[curHash % (Size * 8)] = 1;
     }
 }
 
 // Check if a key is in the bloom filter
 template <typename K, size_t Size>
 bool BloomFilter<K, Size>::find(K key) {
-    // Hash the key
-    uint64_t hash[4];
-    MurmurHash3_x64_128(&key, sizeof(K), 1, hash);
+    return find(KeyHash(key));
+}
 
-    // Check if the key is in the bloom filter
+// Check a key hashed by the caller
+template <typename K, size_t Size>
+bool BloomFilter<K, Size>::find(const KeyHash &keyHash) {
+    // The 128-bit hash is split into four 32-bit hashes, files rely on this layout
     for (int i = 0; i < 4; i++) {
-        if (!bloomfilterData[hash[i] % (Size * 8)]) {
+        uint32_t curHash = keyHash.hash[i / 2] >> (32 * (i % 2));
+        if (!bloomfilterData[curHash % (Size * 8)]) {
             return false;
         }
     }
@@ -89,6 +93,7 @@ int BloomFilter<K, Size>::readFile(std::string path, uint64_t offset) {
 
     // Move the file pointer to the offset
     inFile.seekg(offset, std::ios::beg);
+    inFile.read((char*)&bloomfilterData, Size);
     inFile.close();
     return 0;
 }
@@ -0,0 +1,369 @@
+#pragma once
+#include <atomic>
+#include <cstring>
+#include <cstdint>
+#include <iostream>
+#include <list>
+#include <new>
+#include <random>
+#include "arena.h"
+#include "skiplist.h"
+
+/****************************************************************
+    Skiplist shared by several writers and lock-free readers
+    Nodes are linked with CAS and never removed, a delete is
+    an insert of the tombstone value
+    A new value is linked in front of the older ones, the readers
+    of a snapshot follow the chain back to the version they see
+    Ascending keys are inserted with a finger, each search starts
+    from the predecessors of the key inserted before
+****************************************************************/
+
+// value of a node, the bytes follow the record in the arena
+struct ValueRecord{
+    // a newer version replaces an older one
+    uint64_t version;
+    uint32_t size;
+    // the version it replaced, nullptr for the first one
+    const ValueRecord* older;
+
+    const char* data() const {return reinterpret_cast<const char*>(this + 1);};
+};
+
+template <typename K, typename V>
+struct ConcurrentNode{
+    K key;
+    std::atomic<const ValueRecord*> record;
+    // number of levels of the node
+    int height;
+    // pointers to next nodes in different levels, height entries inline
+    std::atomic<ConcurrentNode<K, V>*> next[1];
+
+    // get the value of the node
+    V value() const {
+        const ValueRecord* rec = record.load(std::memory_order_acquire);
+        return V(rec->data(), rec->size);
+    };
+    size_t valueSize() const {return record.load(std::memory_order_acquire)->size;};
+
+    // get the newest record whose version <= version, nullptr if all are newer
+    const ValueRecord* getRecord(uint64_t version) const {
+        const ValueRecord* rec = record.load(std::memory_order_acquire);
+        while(rec != nullptr && rec->version > version)
+            rec = rec->older;
+        return rec;
+    };
+
+    // get the next node in a level
+    ConcurrentNode<K, V>* getNext(int level) const {return next[level].load(std::memory_order_acquire);};
+};
+
+// predecessors of the last key inserted in each level, kept by a writer between inserts
+// nodes are never removed, so they stay valid predecessors of any larger key
+template <typename K, typename V>
+struct ConcurrentFinger{
+    ConcurrentNode<K, V>* prev[MAX_Level] = {nullptr};
+};
+
+template <typename K, typename V>
+class ConcurrentSkiplist{
+private:
+    std::atomic<size_t> size;
+    // highest level used by any node, only grows
+    std::atomic<int> maxHeight;
+    // all nodes, keys and values live in the arena
+    ConcurrentArena arena;
+    ConcurrentNode<K, V>* head;
+
+    // height of a node
+    int randomLevel();
+    // allocate a node with its tower in the arena
+    ConcurrentNode<K, V>* newNode(K elemKey, int height);
+    // copy the value bytes into the arena
+    ValueRecord* newRecord(const V &elemValue, uint64_t version);
+    // replace the value unless a newer version is already there
+    void setValue(ConcurrentNode<K, V>* node, const V &elemValue, uint64_t version);
+
+    // find the predecessor and successor of elemKey in a level, starting from before
+    void findSpliceForLevel(K elemKey, ConcurrentNode<K, V>* before, int level,
+                            ConcurrentNode<K, V>** prev, ConcurrentNode<K, V>** next);
+    // find the first node whose key >= elemKey
+    ConcurrentNode<K, V>* findGreaterOrEqual(K elemKey);
+
+public:
+    // constructor
+    ConcurrentSkiplist();
+
+    // destructor
+    ~ConcurrentSkiplist();
+
+    // interface for user, insert can be called by several threads at once
+    // with a finger the search starts from the last insert through it, the keys should ascend
+    ConcurrentNode<K, V>* insert(K elemKey, const V &elemValue, uint64_t version,
+                                 ConcurrentFinger<K, V>* finger = nullptr);
+    ConcurrentNode<K, V>* find(K elemKey);
+
+    // get the first node whose key >= elemKey, nullptr if none
+    ConcurrentNode<K, V>* lowerBound(K elemKey);
+
+    // copy current skiplist to a list
+    void copyAll(std::list<std::pair<K, V>> &list);
+
+    // get size of skiplist
+    size_t getSize(){return this->size.load(std::memory_order_relaxed);};
+    // get the bytes held by the arena
+    size_t getMemoryUsage(){return this->arena.getMemoryUsage();};
+
+    void clear(); // release all the nodes at once, no writer or reader may be running
+    void tranverse(); // tranverse the skiplist to print all the elements
+};
+
+// random level generator
+template <typename K, typename V>
+int ConcurrentSkiplist<K, V>::randomLevel(){
+    // every writer draws from its own generator
+    static thread_local std::minstd_rand generator(std::random_device{}());
+
+    int level = 1;
+    while(level < MAX_Level && generator() % 2 == 0){
+        level++;
+    }
+    return level;
+}
+
+// allocate a node with its tower in the arena
+template <typename K, typename V>
+ConcurrentNode<K, V>* ConcurrentSkiplist<K, V>::newNode(K elemKey, int height){
+    // the node already holds one next pointer, the rest of the tower follows it
+    size_t nodeSize = sizeof(ConcurrentNode<K, V>) + sizeof(std::atomic<ConcurrentNode<K, V>*>) * (height - 1);
+    char* mem = this->arena.allocateAligned(nodeSize);
+
+    ConcurrentNode<K, V>* node = new (mem) ConcurrentNode<K, V>();
+    node->key = elemKey;
+    node->record.store(nullptr, std::memory_order_relaxed);
+    node->height = height;
+    for(int i = 0; i < height; i++){
+        new (&node->next[i]) std::atomic<ConcurrentNode<K, V>*>(nullptr);
+    }
+    return node;
+}
+
+// copy the value bytes into the arena
+template <typename K, typename V>
+ValueRecord* ConcurrentSkiplist<K, V>::newRecord(const V &elemValue, uint64_t version){
+    char* mem = this->arena.allocateAligned(sizeof(ValueRecord) + elemValue.size());
+    ValueRecord* rec = new (mem) ValueRecord();
+    rec->version = version;
+    rec->size = elemValue.size();
+    rec->older = nullptr;
+    if(elemValue.size() > 0)
+        memcpy(mem + sizeof(ValueRecord), elemValue.data(), elemValue.size());
+    return rec;
+}
+
+// replace the value unless a newer version is already there
+// writers of the same key may finish in any order, the highest version wins
+template <typename K, typename V>
+void ConcurrentSkiplist<K, V>::setValue(ConcurrentNode<K, V>* node, const V &elemValue, uint64_t version){
+    ValueRecord* rec = this->newRecord(elemValue, version);
+    const ValueRecord* cur = node->record.load(std::memory_order_acquire);
+
+    // the old record stays in the arena until it is released, linked behind the new one
+    while(cur == nullptr || cur->version <= version){
+        rec->older = cur;
+        if(node->record.compare_exchange_weak(cur, rec, std::memory_order_release, std::memory_order_acquire))
+            return;
+    }
+}
+
+// initialize a skiplist with only the head node
+template <typename K, typename V>
+ConcurrentSkiplist<K, V>::ConcurrentSkiplist(){
+    // initialize the head node with the full tower
+    head = newNode(K(), MAX_Level);
+    maxHeight.store(1, std::memory_order_relaxed);
+
+    // record the size
+    size.store(0, std::memory_order_relaxed);
+}
+
+// destructor of skiplist
+// nodes are released together with the arena
+template <typename K, typename V>
+ConcurrentSkiplist<K, V>::~ConcurrentSkiplist(){
+}
+
+// find the predecessor and successor of elemKey in a level
+template <typename K, typename V>
+void ConcurrentSkiplist<K, V>::findSpliceForLevel(K elemKey, ConcurrentNode<K, V>* before, int level,
+                                                  ConcurrentNode<K, V>** prev, ConcurrentNode<K, V>** next){
+    while(true){
+        ConcurrentNode<K, V>* after = before->getNext(level);
+        if(after == nullptr || !(after->key < elemKey)){
+            *prev = before;
+            *next = after;
+            return;
+        }
+        before = after;
+    }
+}
+
+// find the first node whose key >= elemKey
+template <typename K, typename V>
+ConcurrentNode<K, V>* ConcurrentSkiplist<K, V>::findGreaterOrEqual(K elemKey){
+    ConcurrentNode<K, V>* iter = head;
+    ConcurrentNode<K, V>* level_next = nullptr;
+
+    // tranverse from the top level down to level 0
+    for(int level = maxHeight.load(std::memory_order_relaxed) - 1; level >= 0; level--){
+        this->findSpliceForLevel(elemKey, iter, level, &iter, &level_next);
+    }
+    return level_next;
+}
+
+// insert a node into the skiplist
+template <typename K, typename V>
+ConcurrentNode<K, V>* ConcurrentSkiplist<K, V>::insert(K elemKey, const V &elemValue, uint64_t version,
+                                                       ConcurrentFinger<K, V>* finger){
+    // predecessor and successor of the new node in each level, kept on the stack
+    ConcurrentNode<K, V>* prev[MAX_Level];
+    ConcurrentNode<K, V>* next[MAX_Level];
+
+    /*******************************************
+        Step 1: Check the key and find the path
+    ********************************************/
+
+    // the levels above the current height are empty, a writer raising it meanwhile
+    // makes the link below fail and search those levels again
+    int height = maxHeight.load(std::memory_order_acquire);
+    for(int level = MAX_Level - 1; level >= height; level--){
+        prev[level] = head;
+        next[level] = nullptr;
+    }
+
+    ConcurrentNode<K, V>* iter = head;
+    for(int level = height - 1; level >= 0; level--){
+        // jump to the finger if it is a closer predecessor
+        if(finger != nullptr){
+            ConcurrentNode<K, V>* closer = finger->prev[level];
+            if(closer != nullptr && closer != head && closer->key < elemKey && (iter == head || iter->key < closer->key))
+                iter = closer;
+        }
+        this->findSpliceForLevel(elemKey, iter, level, &prev[level], &next[level]);
+        iter = prev[level];
+    }
+    if(finger != nullptr){
+        for(int level = 0; level < MAX_Level; level++)
+            finger->prev[level] = prev[level];
+    }
+
+    // update the value if the key exists
+    if(next[0] != nullptr && next[0]->key == elemKey){
+        this->setValue(next[0], elemValue, version);
+        return next[0];
+    }
+
+    /*******************************************
+        Step 2: Insert the new node
+    ********************************************/
+
+    int newNode_level = randomLevel();
+
+    // raise the height so that readers start from the new levels
+    int curHeight = maxHeight.load(std::memory_order_relaxed);
+    while(newNode_level > curHeight){
+        if(maxHeight.compare_exchange_weak(curHeight, newNode_level, std::memory_order_release))
+            break;
+    }
+
+    ConcurrentNode<K, V>* newNode = this->newNode(elemKey, newNode_level);
+    newNode->record.store(this->newRecord(elemValue, version), std::memory_order_relaxed);
+
+    // link from the bottom, a node is visible once it is in level 0
+    for(int i = 0; i < newNode_level; i++){
+        while(true){
+            newNode->next[i].store(next[i], std::memory_order_relaxed);
+            if(prev[i]->next[i].compare_exchange_strong(next[i], newNode, std::memory_order_release))
+                break;
+
+            // another writer linked a node here, search again from the old predecessor
+            this->findSpliceForLevel(elemKey, prev[i], i, &prev[i], &next[i]);
+
+            // the same key was inserted meanwhile, the new node is dropped
+            if(i == 0 && next[0] != nullptr && next[0]->key == elemKey){
+                this->setValue(next[0], elemValue, version);
+                return next[0];
+            }
+        }
+    }
+
+    // the new node is the closest predecessor of the next key
+    if(finger != nullptr){
+        for(int i = 0; i < newNode_level; i++)
+            finger->prev[i] = newNode;
+    }
+
+    // update the size of the skiplist
+    this->size.fetch_add(1, std::memory_order_relaxed);
+
+    return newNode;
+}
+
+// find a node in the skiplist
+template <typename K, typename V>
+ConcurrentNode<K, V>* ConcurrentSkiplist<K, V>::find(K elemKey){
+    ConcurrentNode<K, V>* tryFind = this->findGreaterOrEqual(elemKey);
+
+    if(tryFind != nullptr && tryFind->key == elemKey)
+        return tryFind;
+    return nullptr;
+}
+
+// get the first node whose key >= elemKey
+template <typename K, typename V>
+ConcurrentNode<K, V>* ConcurrentSkiplist<K, V>::lowerBound(K elemKey){
+    return this->findGreaterOrEqual(elemKey);
+}
+
+// copy all the elements in skiplist to a list
+template <typename K, typename V>
+void ConcurrentSkiplist<K, V>::copyAll(std::list<std::pair<K, V>> &list){
+    ConcurrentNode<K, V>* iter = head->getNext(0);
+    while(iter != nullptr){
+        list.push_back(std::make_pair(iter->key, iter->value()));
+        iter = iter->getNext(0);
+    }
+}
+
+// release all the nodes in skiplist at once
+template <typename K, typename V>
+void ConcurrentSkiplist<K, V>::clear(){
+    this->arena.reset();
+
+    // the head lived in the arena as well
+    head = newNode(K(), MAX_Level);
+    maxHeight.store(1, std::memory_order_relaxed);
+
+    // set the size to 0
+    this->size.store(0, std::memory_order_relaxed);
+}
+
+// tranverse the skiplist to print all the elements
+template <typename K, typename V>
+void ConcurrentSkiplist<K, V>::tranverse(){
+    std::cout << "####################" << std::endl;
+
+    ConcurrentNode<K, V>* iter = head->getNext(0);
+    while(iter != nullptr){
+        std::cout << "key: " << iter->key << "value: " << iter->value() << " level [";
+        for(int i = 0; i < iter->height; i++){
+            if(iter->getNext(i) == nullptr)
+                std::cout << "End, ";
+            else
+                std::cout << iter->getNext(i)->key << ", ";
+        }
+        std::cout << "]" << std::endl;
+
+        iter = iter->getNext(0);
+    }
+}
@@ -1,44 +1,169 @@
-#pragma once
-#include <cmath>
-
-// SSTable: Header
-#define sstable_headerSize 32
-
-// SSTable: Bloom Filter
-#define sstable_bfSize 8192
-
-// SSTable: Key
-#define sstable_keySize 8
-
-// SSTable: Value
-#define sstable_offsetSize 1024
-
-// SSTable: Vlen
-#define sstable_vlenSize 4
-
-// SSTable: Limitation(16*1024)
-#define sstable_maxSize 16384
-
-// SSTable: File num limitation for each level
-#define level_max_file_num(n) pow(2, n+1)
-
-// SSTable: Out of Range
-#define sstable_out_of_range "~![ERROR] Out of Range!~"
-
-// Log: Path
-#define logFilePath "./WAL.log"
-
-// MemTable: Delete Tag
-#define delete_tag "~DELETED~"
-
-// MemTable: Already Deleted
-#define memtable_already_deleted "~![ERROR] ALREADY DELETED!~"
-
-// MemTable: Not Found
-#define memtable_not_exist "~![ERROR] MemTable No Exist!~"
-
-// vLog: Exceed Limit
-#define sstvalue_outOfRange "~![ERROR] Exceed Limit!~"
-
-// vLog: No File to read
-#define sstvalue_readFile_file "~![ERROR] No File!~"
+#pragma once
+#include <cmath>
+
+// SSTable: Header
+#define sstable_headerSize 32
+
+// SSTable: Bloom Filter
+#define sstable_bfSize 8192
+
+// SSTable: Filter formats, a versioned filter starts with the magic
+#define sstable_filter_magic 0x544C4946     // "FILT"
+#define sstable_filter_legacy 0             // BloomFilter without a header, 4 probes over the whole filter
+#define sstable_filter_blocked 1            // BlockedBloomFilter, all probes in one cache line
+#define sstable_filter_xor 2                // XorFilter, 3 probes, built once all the keys are known
+#define sstable_filter_range 3              // RangeFilter after the index, prefixes of the keys for scan
+
+// SSTable: Filter format of the new sstables
+#define sstable_filter_format sstable_filter_blocked
+
+// SSTable: Filter bits per key of the new sstables, the legacy filter is always sstable_bfSize
+#define sstable_filter_bits_per_key 10
+
+// SSTable: Give the shallower levels more bits per key at the same total memory (Monkey)
+#define sstable_filter_per_level false
+
+// SSTable: Range filter bits per distinct key prefix, 0 to write no range filter
+#define sstable_range_filter_bits_per_prefix 10
+
+// SSTable: Range filter prefixes are key >> (i * step) for i in 1..levels
+#define sstable_range_filter_step 4
+#define sstable_range_filter_levels 8
+
+// SSTable: Most prefixes checked for one range, a wider range is let through
+#define sstable_range_filter_max_probes 16
+
+// SSTable: Magic ending the sequence numbers of the index entries, the tables written before them have none
+#define sstable_seq_magic 0x53514553        // "SEQS"
+
+// SSTable: Key
+#define sstable_keySize 8
+
+// SSTable: Value
+#define sstable_offsetSize 1024
+
+// SSTable: Vlen
+#define sstable_vlenSize 4
+
+// SSTable: Limitation(16*1024)
+#define sstable_maxSize 16384
+
+// Compaction: Level-0 file num that starts a merge
+#define level0_compaction_trigger 2
+
+// Compaction: Number of levels, the last one is sized by the data it holds
+#define level_num 7
+
+// Compaction: Size ratio of two adjacent levels
+#define level_fanout 10
+
+// Compaction: Least target bytes of the base level, the one level-0 merges into
+#define level_base_bytes (8 * sstable_maxSize)
+
+// Compaction: Background threads
+#define compaction_thread_num 2
+
+// Compaction: Styles
+#define compaction_leveled 0    // a level is one sorted run, an overflow merges into the next level
+#define compaction_tiered 1     // a level gathers sorted runs, they are merged whole into one run of the next level
+
+// Compaction: Default style
+#define compaction_style compaction_leveled
+
+// Compaction: Sorted runs a tiered level holds, one more merges them into the next level
+#define compaction_tiered_size_ratio 4
+
+// Compaction: Most key ranges a merge is split into, each merged by its own thread
+#define compaction_max_subcompactions 4
+
+// RateLimit: Bytes per second of the flushes, merges and gc relocations, 0 to disable
+#define ratelimit_bytes_per_second 0
+
+// RateLimit: Refill period(us), the bucket holds at most one period's bytes
+#define ratelimit_refill_period_us 10000
+
+// RateLimit: Priorities, a low priority request yields to a high one
+#define ratelimit_high 0        // memtable flushes, the writers wait on them
+#define ratelimit_low 1         // merges and gc relocations
+#define ratelimit_priority_num 2
+
+// RateLimit: Raise the rate with the compaction debt, the bytes the levels hold over their targets
+#define ratelimit_auto_tune true
+
+// RateLimit: Most times the configured rate the auto tuning goes up to
+#define ratelimit_max_boost 8
+
+// Compaction: Level-0 file num to slow down writes
+#define level0_slowdown_trigger 8
+
+// Compaction: Level-0 file num to stop writes
+#define level0_stop_trigger 12
+
+// Compaction: Delay of a slowed down write(us)
+#define level0_slowdown_delay 1000
+
+// SSTable: Out of Range
+#define sstable_out_of_range "~![ERROR] Out of Range!~"
+
+// Log: Path
+#define logFilePath "./WAL.log"
+
+// Log: Path of the frozen memtable waiting for flush
+#define immLogFilePath "./WAL.imm.log"
+
+// Log: Durability modes
+#define wal_sync_write 0        // fdatasync every write
+#define wal_sync_group 1        // fdatasync once for a group of writes
+#define wal_sync_interval 2     // fdatasync at most once every interval
+
+// Log: Default durability mode
+#define wal_sync_mode wal_sync_interval
+
+// Log: Interval of wal_sync_interval(ms)
+#define wal_sync_interval_ms 100
+
+// MemTable: Block size of the arena
+#define arena_blockSize 4096
+
+// Version: Slots caching a pinned version for the reader threads
+#define version_cache_slots 64
+
+// Version: Fence pointers per chunk, a level change copies only the chunks it touches
+#define version_fence_chunk 64
+
+// MemTable: Delete Tag
+#define delete_tag "~DELETED~"
+
+// MemTable: Already Deleted
+#define memtable_already_deleted "~![ERROR] ALREADY DELETED!~"
+
+// MemTable: Not Found
+#define memtable_not_exist "~![ERROR] MemTable No Exist!~"
+
+// vLog: Read modes
+#define vlog_read_pread 0       // pread every value
+#define vlog_read_mmap 1        // copy the value from a mapping of the file
+
+// vLog: Default read mode
+#define vlog_read_mode vlog_read_pread
+
+// vLog: Largest gap between two values fetched by one multiGet read, the bytes in between are dropped
+#define vlog_coalesce_gap 4096
+
+// vLog: Size of the write buffer, a larger batch is written in several pieces
+#define vlog_buffer_size (1024 * 1024)
+
+// vLog: Bytes preallocated past head with fallocate, 0 to disable
+#define vlog_prealloc_size (4 * 1024 * 1024)
+
+// Cache: Bytes of vLog values cached, 0 to disable
+#define value_cache_size (8 * 1024 * 1024)
+
+// Cache: Number of shards of the value cache
+#define value_cache_shard_num 16
+
+// vLog: Exceed Limit
+#define sstvalue_outOfRange "~![ERROR] Exceed Limit!~"
+
+// vLog: No File to read
+#define sstvalue_readFile_file "~![ERROR] No File!~"
@@ -1,6 +1,8 @@
 #include <iostream>
 #include <cstdint>
 #include <string>
+#include <thread>
+#include <vector>
 #include <assert.h>
 
 #include "test.h"
@@ -11,6 +13,12 @@ private:
 	const uint64_t SIMPLE_TEST_MAX = 512;
 	const uint64_t LARGE_TEST_MAX = 1024 * 64;
 	const uint64_t GC_TEST_MAX = 1024 * 48;
+	const uint64_t EMPTY_VALUE_GC_TEST_MAX = 1024;
+	const uint64_t CONCURRENT_TEST_MAX = 1024 * 8;
+	const uint64_t CONCURRENT_TEST_THREADS = 4;
+	const uint64_t ITERATOR_TEST_MAX = 1024 * 4;
+	const uint64_t SNAPSHOT_TEST_MAX = 1024 * 4;
+	const uint64_t MULTIGET_TEST_MAX = 1024 * 4;
 
 	void regular_test(uint64_t max)
 	{
@@ -191,6 +199,224 @@ private:
 		report();
 	}
 
+	void empty_value_gc_test(uint64_t max)
+	{
+		uint64_t i;
+
+		// An empty value is a vLog entry with the header alone
+		for (i = 0; i < max; ++i)
+			store.put(i, (i & 1) ? "" : std::string(i + 1, 'e'));
+
+		for (i = 0; i < max; i += 4)
+			EXPECT(true, store.del(i));
+
+		phase();
+
+		// gc moves the empty values and the tombstones along with the others
+		store.gc(64 * 1024);
+		store.gc(64 * 1024);
+
+		for (i = 0; i < max; ++i)
+			EXPECT((i % 4 == 0 || (i & 1)) ? not_found : std::string(i + 1, 'e'),
+				   store.get(i));
+
+		// The empty values are still there, the deleted keys are not
+		std::list<std::pair<uint64_t, std::string>> list_stu;
+		store.scan(0, max - 1, list_stu);
+		EXPECT(max - max / 4, list_stu.size());
+
+		phase();
+
+		report();
+	}
+
+	void concurrent_test(uint64_t max, uint64_t threads)
+	{
+		uint64_t i;
+
+		// The writers share the memtable, each one puts its own keys
+		std::vector<std::thread> writers;
+		for (uint64_t t = 0; t < threads; ++t)
+			writers.emplace_back([this, max, threads, t]
+			{
+				for (uint64_t key = t; key < max; key += threads)
+					store.put(key, std::string(key % 512 + 1, 'a' + t));
+			});
+		for (auto &writer : writers)
+			writer.join();
+
+		for (i = 0; i < max; ++i)
+			EXPECT(std::string(i % 512 + 1, 'a' + i % threads), store.get(i));
+
+		phase();
+
+		// Readers run along the writers, a key holds the old value or the new one
+		writers.clear();
+		std::vector<uint64_t> torn(threads, 0);
+		for (uint64_t t = 0; t < threads; ++t)
+			writers.emplace_back([this, max, threads, t, &torn]
+			{
+				for (uint64_t key = t; key < max; key += threads)
+				{
+					store.put(key, std::string(key % 512 + 1, 'A' + t));
+					std::string other = store.get((key + 1) % max);
+					uint64_t owner = (key + 1) % max % threads;
+					if (other != std::string((key + 1) % max % 512 + 1, 'a' + owner)
+						&& other != std::string((key + 1) % max % 512 + 1, 'A' + owner))
+						torn[t]++;
+				}
+			});
+		for (auto &writer : writers)
+			writer.join();
+
+		uint64_t tornAll = 0;
+		for (uint64_t t = 0; t < threads; ++t)
+			tornAll += torn[t];
+		EXPECT((uint64_t)0, tornAll);
+		for (i = 0; i < max; ++i)
+			EXPECT(std::string(i % 512 + 1, 'A' + i % threads), store.get(i));
+
+		phase();
+
+		report();
+	}
+
+	void iterator_test(uint64_t max)
+	{
+		uint64_t i;
+
+		// The keys are put out of order, some are deleted in the sstables and some in the memtable
+		for (i = 0; i < max; ++i)
+			store.put((i * 7) % max, std::string((i * 7) % max % 256 + 1, 'i'));
+		for (i = 0; i < max; i += 5)
+			EXPECT(true, store.del(i));
+		for (i = 0; i < max; i += 10)
+			store.put(i, "back");
+
+		// Every key once in ascending order, the deleted ones skipped
+		Iterator *iter = store.newIterator();
+		uint64_t count = 0;
+		uint64_t expected = 0;
+		for (iter->seekToFirst(); iter->valid(); iter->next())
+		{
+			while (expected % 10 != 0 && expected % 5 == 0)
+				++expected;
+			EXPECT(expected, iter->key());
+			EXPECT((expected % 10 == 0) ? std::string("back") : std::string(expected % 256 + 1, 'i'),
+				   iter->value());
+			++expected;
+			++count;
+		}
+		expected = 0;
+		for (i = 0; i < max; ++i)
+			expected += (i % 10 == 0 || i % 5 != 0);
+		EXPECT(expected, count);
+		delete iter;
+
+		phase();
+
+		// Seek lands on the next visible key, the upper bound is included
+		iter = store.newIterator(max / 2);
+		iter->seek(5);
+		EXPECT(true, iter->valid());
+		EXPECT((uint64_t)6, iter->key());
+		count = 0;
+		for (; iter->valid(); iter->next())
+			++count;
+		expected = 0;
+		for (i = 6; i <= max / 2; ++i)
+			expected += (i % 10 == 0 || i % 5 != 0);
+		EXPECT(expected, count);
+		delete iter;
+
+		phase();
+
+		report();
+	}
+
+	void snapshot_test(uint64_t max)
+	{
+		uint64_t i;
+
+		for (i = 0; i < max; ++i)
+			store.put(i, std::string(i % 256 + 1, 'a'));
+		const Snapshot *snapshot = store.getSnapshot();
+
+		// Enough overwrites to flush the memtables and merge the levels under the snapshot
+		for (char c = 'b'; c <= 'd'; ++c)
+			for (i = 0; i < max; ++i)
+				store.put(i, std::string(i % 256 + 1, c));
+		for (i = 0; i < max; i += 3)
+			EXPECT(true, store.del(i));
+
+		for (i = 0; i < max; ++i)
+		{
+			EXPECT(std::string(i % 256 + 1, 'a'), store.get(i, snapshot));
+			EXPECT((i % 3 == 0) ? not_found : std::string(i % 256 + 1, 'd'), store.get(i));
+		}
+
+		phase();
+
+		// Scan sees the snapshot too
+		std::list<std::pair<uint64_t, std::string>> list_stu;
+		store.scan(0, max - 1, list_stu, snapshot);
+		EXPECT(max, list_stu.size());
+		i = 0;
+		for (auto &pair : list_stu)
+		{
+			EXPECT(i, pair.first);
+			EXPECT(std::string(i % 256 + 1, 'a'), pair.second);
+			++i;
+		}
+
+		phase();
+
+		// After the release the latest versions are left
+		store.releaseSnapshot(snapshot);
+		for (i = 0; i < max; ++i)
+			store.put(i, std::string(i % 256 + 1, 'e'));
+		for (i = 0; i < max; ++i)
+			EXPECT(std::string(i % 256 + 1, 'e'), store.get(i));
+
+		phase();
+
+		report();
+	}
+
+	void multiget_test(uint64_t max)
+	{
+		uint64_t i;
+
+		for (i = 0; i < max; ++i)
+			store.put(i, std::string(i % 256 + 1, 'm'));
+		for (i = 0; i < max; i += 4)
+			EXPECT(true, store.del(i));
+
+		// The keys in any order with repeats and missing keys
+		std::vector<uint64_t> keys;
+		for (i = 0; i < max; ++i)
+			keys.push_back((i * 13) % max);
+		keys.push_back(max + 1);
+		keys.push_back(1);
+
+		std::vector<std::string> values = store.multiGet(keys);
+		EXPECT(keys.size(), values.size());
+		values.resize(keys.size());
+		for (i = 0; i < keys.size(); ++i)
+		{
+			std::string value = values[i];
+			EXPECT(store.get(keys[i]), value);
+		}
+		std::string missing = values[max];
+		EXPECT(not_found, missing);
+		std::string repeated = values[max + 1];
+		EXPECT(std::string(2, 'm'), repeated);
+
+		phase();
+
+		report();
+	}
+
 public:
 	CorrectnessTest(const std::string &dir, const std::string &vlog, bool v = true) : Test(dir, vlog, v)
 	{
@@ -214,6 +440,31 @@ public:
 
 		std::cout << "[GC Test]" << std::endl;
 		gc_test(GC_TEST_MAX);
+
+		store.reset();
+
+		std::cout << "[Empty Value GC Test]" << std::endl;
+		empty_value_gc_test(EMPTY_VALUE_GC_TEST_MAX);
+
+		store.reset();
+
+		std::cout << "[Concurrent Test]" << std::endl;
+		concurrent_test(CONCURRENT_TEST_MAX, CONCURRENT_TEST_THREADS);
+
+		store.reset();
+
+		std::cout << "[Iterator Test]" << std::endl;
+		iterator_test(ITERATOR_TEST_MAX);
+
+		store.reset();
+
+		std::cout << "[Snapshot Test]" << std::endl;
+		snapshot_test(SNAPSHOT_TEST_MAX);
+
+		store.reset();
+
+		std::cout << "[MultiGet Test]" << std::endl;
+		multiget_test(MULTIGET_TEST_MAX);
 	}
 };
 
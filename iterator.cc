@@ -0,0 +1,324 @@
+#include "iterator.h"
+#include "kvstore.h"
+#include <algorithm>
+#include <cstring>
+
+/****************************************************************************************
+ **                                   Merge sources                                   **
+ ****************************************************************************************/
+
+// Entries of a memtable, the skiplist is walked at level 0
+class MemSource : public MergeSource {
+private:
+    MemTable* memtable;
+    uint64_t sequence;
+    ConcurrentNode<uint64_t, std::string>* node = nullptr;
+    // Version of the node seen by the iterator
+    const ValueRecord* record = nullptr;
+
+    // Skip the nodes inserted after the snapshot
+    void settle() {
+        while (this->node != nullptr && (this->record = this->node->getRecord(this->sequence)) == nullptr)
+            this->node = this->node->getNext(0);
+    };
+
+public:
+    MemSource(MemTable* memtable, uint64_t sequence) : memtable(memtable), sequence(sequence) {};
+
+    void seek(uint64_t target) override {
+        this->node = this->memtable->lowerBound(target);
+        this->settle();
+    };
+    bool valid() override {return this->node != nullptr;};
+    void next() override {
+        this->node = this->node->getNext(0);
+        this->settle();
+    };
+    uint64_t key() override {return this->node->key;};
+    std::string value() override {return std::string(this->record->data(), this->record->size);};
+
+    bool isDeleted() override {
+        return this->record->size == strlen(delete_tag) && this->value() == delete_tag;
+    };
+};
+
+// Entries of an sstable of level-0 or of an overlapping level
+class TableSource : public MergeSource {
+private:
+    SStable* sstable;
+    vLog* vlog;
+    ValueCache* cache;
+    uint64_t upperBound;
+    uint64_t sequence;
+    uint64_t &skipped, &scanned;
+    uint64_t pos = 0;
+
+    // Skip the versions newer than the snapshot
+    void settle() {
+        while (this->valid() && this->sstable->getSStableKeySeq(this->pos) > this->sequence)
+            this->pos++;
+    };
+
+public:
+    TableSource(SStable* sstable, vLog* vlog, ValueCache* cache, uint64_t upperBound, uint64_t sequence,
+                uint64_t &skipped, uint64_t &scanned)
+        : sstable(sstable), vlog(vlog), cache(cache), upperBound(upperBound), sequence(sequence),
+          skipped(skipped), scanned(scanned) {};
+
+    void seek(uint64_t target) override {
+        // Skip the sstable without a key in the range
+        if (target > this->upperBound || !this->sstable->checkIfRangeExist(target, this->upperBound)) {
+            this->skipped++;
+            this->pos = this->sstable->getSStableKeyValNum();
+            return;
+        }
+        this->scanned++;
+        this->pos = this->sstable->getLowerBoundIndex(target);
+        this->settle();
+    };
+    bool valid() override {return this->pos < this->sstable->getSStableKeyValNum();};
+
+    // Skip the older versions of the key as well
+    void next() override {
+        uint64_t current = this->key();
+        do {
+            this->pos++;
+        } while (this->valid() && this->key() == current);
+        this->settle();
+    };
+    uint64_t key() override {return this->sstable->getSStableKey(this->pos);};
+
+    std::string value() override {
+        return this->cache->read(*this->vlog,
+            this->sstable->getSStableKeyOffset(this->pos), this->sstable->getSStableKeyVlen(this->pos));
+    };
+
+    // Only a value as long as the tag is read to check it
+    bool isDeleted() override {
+        return this->sstable->getSStableKeyVlen(this->pos) == strlen(delete_tag) && this->value() == delete_tag;
+    };
+};
+
+// Entries of a level >= 1, the sstables are walked one after the other along the fences
+class LevelSource : public MergeSource {
+private:
+    const LevelFences* fences;
+    vLog* vlog;
+    ValueCache* cache;
+    uint64_t upperBound;
+    uint64_t sequence;
+    uint64_t &skipped, &scanned;
+    // Current sstable and position in it
+    size_t fence = 0;
+    uint64_t pos = 0;
+
+    SStable* sstable() {return this->fences->at(this->fence).sstable.get();};
+
+    // Skip the versions newer than the snapshot, true if a version is left in the sstable
+    bool settle() {
+        uint64_t keyValNum = this->sstable()->getSStableKeyValNum();
+        while (this->pos < keyValNum && this->sstable()->getSStableKeySeq(this->pos) > this->sequence)
+            this->pos++;
+        return this->pos < keyValNum;
+    };
+
+    // Move to the first key >= target from the current sstable on
+    void enterTable(uint64_t target) {
+        size_t total = this->fences->size();
+        for (; this->fence < total; this->fence++) {
+            // The sstables past the upper bound are skipped without a look
+            if (this->fences->at(this->fence).minKey > this->upperBound) {
+                this->skipped += total - this->fence;
+                this->fence = total;
+                return;
+            }
+            if (!this->sstable()->checkIfRangeExist(target, this->upperBound)) {
+                this->skipped++;
+                continue;
+            }
+            this->scanned++;
+            this->pos = this->sstable()->getLowerBoundIndex(target);
+            if (this->settle())
+                return;
+        }
+    };
+
+public:
+    LevelSource(const LevelFences* fences, vLog* vlog, ValueCache* cache, uint64_t upperBound, uint64_t sequence,
+                uint64_t &skipped, uint64_t &scanned)
+        : fences(fences), vlog(vlog), cache(cache), upperBound(upperBound), sequence(sequence),
+          skipped(skipped), scanned(scanned) {};
+
+    void seek(uint64_t target) override {
+        // The sstables before the fence of the target are skipped without a look
+        this->fence = Version::seekFence(*this->fences, target);
+        this->skipped += this->fence;
+        if (target > this->upperBound) {
+            this->skipped += this->fences->size() - this->fence;
+            this->fence = this->fences->size();
+            return;
+        }
+        this->enterTable(target);
+    };
+    bool valid() override {return this->fence < this->fences->size();};
+
+    // Skip the older versions of the key as well, they are in the same sstable
+    void next() override {
+        uint64_t current = this->key();
+        uint64_t keyValNum = this->sstable()->getSStableKeyValNum();
+        do {
+            this->pos++;
+        } while (this->pos < keyValNum && this->key() == current);
+        if (this->settle())
+            return;
+        this->fence++;
+        if (this->fence < this->fences->size())
+            this->enterTable(this->fences->at(this->fence).minKey);
+    };
+    uint64_t key() override {return this->sstable()->getSStableKey(this->pos);};
+
+    std::string value() override {
+        return this->cache->read(*this->vlog,
+            this->sstable()->getSStableKeyOffset(this->pos), this->sstable()->getSStableKeyVlen(this->pos));
+    };
+
+    // Only a value as long as the tag is read to check it
+    bool isDeleted() override {
+        return this->sstable()->getSStableKeyVlen(this->pos) == strlen(delete_tag) && this->value() == delete_tag;
+    };
+};
+
+// Order of the heap, the smallest key comes first, then the newest source
+static bool heapAfter(MergeSource* a, MergeSource* b) {
+    uint64_t keyA = a->key(), keyB = b->key();
+    if (keyA != keyB)
+        return keyA > keyB;
+    return a->rank > b->rank;
+}
+
+/****************************************************************************************
+ **                                 Private functions                                  **
+ ****************************************************************************************/
+
+// Add the sstables of a level-0 or an overlapping level, newest first
+void Iterator::addTableSources(const std::map<uint64_t, std::shared_ptr<SStable> > &level) {
+    std::vector<std::pair<uint64_t, SStable*> > tables;
+    for (auto sstable = level.rbegin(); sstable != level.rend(); sstable++)
+        tables.push_back({sstable->second->getSStableTimeStamp(), sstable->second.get()});
+    // A larger timestamp is newer, the larger file id comes first on a tie
+    std::stable_sort(tables.begin(), tables.end(),
+        [](const std::pair<uint64_t, SStable*> &a, const std::pair<uint64_t, SStable*> &b) { return a.first > b.first; });
+
+    for (auto &table : tables)
+        this->sources.push_back(new TableSource(table.second, this->version->vlog.get(), this->version->valueCache.get(),
+            this->upperBound, this->sequence, this->skipped, this->scanned));
+}
+
+// Advance all the sources at the current key
+void Iterator::skipCurrentKey() {
+    uint64_t current = this->heap.front()->key();
+    while (!this->heap.empty() && this->heap.front()->key() == current) {
+        std::pop_heap(this->heap.begin(), this->heap.end(), heapAfter);
+        MergeSource* source = this->heap.back();
+        this->heap.pop_back();
+
+        source->next();
+        if (source->valid()) {
+            this->heap.push_back(source);
+            std::push_heap(this->heap.begin(), this->heap.end(), heapAfter);
+        }
+    }
+}
+
+// Move to the first key that is not deleted
+void Iterator::findNextVisible() {
+    while (!this->heap.empty()) {
+        // The front is the newest entry of the smallest key
+        MergeSource* front = this->heap.front();
+        if (front->key() > this->upperBound) {
+            this->heap.clear();
+            return;
+        }
+        if (!front->isDeleted())
+            return;
+        this->skipCurrentKey();
+    }
+}
+
+/****************************************************************************************
+ **                                 Public functions                                   **
+ ****************************************************************************************/
+
+// Constructor, pin the current version until the iterator is deleted
+Iterator::Iterator(KVStore* store, uint64_t upperBound, uint64_t sequence) {
+    this->store = store;
+    this->upperBound = upperBound;
+    this->sequence = sequence;
+    this->version = store->versions.pin();
+
+    // The memtable is newer than the immutable one, which is newer than the sstables
+    this->sources.push_back(new MemSource(this->version->memtable.get(), sequence));
+    if (this->version->immMemtable != nullptr)
+        this->sources.push_back(new MemSource(this->version->immMemtable.get(), sequence));
+
+    // A level is newer than the levels below it
+    for (auto level = this->version->levels->begin(); level != this->version->levels->end(); level++) {
+        const LevelFences* fences = level->second->getFences();
+        if (fences != nullptr)
+            this->sources.push_back(new LevelSource(fences, this->version->vlog.get(), this->version->valueCache.get(), upperBound, sequence,
+                this->skipped, this->scanned));
+        else
+            this->addTableSources(level->second->sstables);
+    }
+
+    for (size_t i = 0; i < this->sources.size(); i++)
+        this->sources[i]->rank = i;
+}
+
+// Destructor
+Iterator::~Iterator() {
+    for (MergeSource* source : this->sources)
+        delete source;
+    this->store->versions.release(this->version, -1);
+
+    this->store->scanSSTablesSkipped.fetch_add(this->skipped, std::memory_order_relaxed);
+    this->store->scanSSTablesScanned.fetch_add(this->scanned, std::memory_order_relaxed);
+}
+
+// Position at the first key
+void Iterator::seekToFirst() {
+    this->seek(0);
+}
+
+// Position at the first key >= target
+void Iterator::seek(uint64_t target) {
+    this->heap.clear();
+    for (MergeSource* source : this->sources) {
+        source->seek(target);
+        if (source->valid())
+            this->heap.push_back(source);
+    }
+    std::make_heap(this->heap.begin(), this->heap.end(), heapAfter);
+    this->findNextVisible();
+}
+
+// Check if the iterator is at a key
+bool Iterator::valid() {
+    return !this->heap.empty();
+}
+
+// Move to the next key
+void Iterator::next() {
+    this->skipCurrentKey();
+    this->findNextVisible();
+}
+
+// Key of the current position
+uint64_t Iterator::key() {
+    return this->heap.front()->key();
+}
+
+// Value of the current position, read from the vLog if it is in an sstable
+std::string Iterator::value() {
+    return this->heap.front()->value();
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include "version.h"
+#include "sstable.h"
+#include "memtable.h"
+#include "vLog.h"
+#include "valuecache.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class KVStore;
+
+// A sorted run merged by the iterator: a memtable, an sstable or a level of sstables
+class MergeSource {
+public:
+    // Lower is newer, the newest source of a key wins
+    uint64_t rank = 0;
+
+    virtual ~MergeSource(){};
+
+    // Position at the first key >= target
+    virtual void seek(uint64_t target) = 0;
+    virtual bool valid() = 0;
+    virtual void next() = 0;
+    virtual uint64_t key() = 0;
+    // Check if the entry is a tombstone
+    virtual bool isDeleted() = 0;
+    virtual std::string value() = 0;
+};
+
+/****************************************************************
+    Iterator: the key-value pairs of the store in key order
+    The memtables and the sstables of one pinned version are
+    merged with a heap, the newest entry of a key wins and the
+    deleted keys are skipped, a value is read from the vLog only
+    when asked for
+    Each source skips the versions newer than the sequence number
+    of the iterator, so that it reads a snapshot
+    One cursor per memtable, per level-0 sstable and per level
+    The iterator must be deleted before the store
+****************************************************************/
+
+class Iterator {
+private:
+    KVStore* store;
+    Version* version;
+    // Keys past it end the iteration
+    uint64_t upperBound;
+    // Versions newer than it are not seen
+    uint64_t sequence;
+
+    // All the sources, newest first
+    std::vector<MergeSource*> sources;
+    // Sources positioned at a key, the front one has the smallest key, then the smallest rank
+    std::vector<MergeSource*> heap;
+
+    // Sstables skipped and read by the seeks, added to the store statistics at the end
+    uint64_t skipped = 0;
+    uint64_t scanned = 0;
+
+    // Add the sstables of a level-0 or an overlapping level, newest first
+    void addTableSources(const std::map<uint64_t, std::shared_ptr<SStable> > &level);
+    // Advance all the sources at the current key
+    void skipCurrentKey();
+    // Move to the first key that is not deleted
+    void findNextVisible();
+
+public:
+    Iterator(KVStore* store, uint64_t upperBound = UINT64_MAX, uint64_t sequence = UINT64_MAX);
+    ~Iterator();
+
+    // Position at the first key
+    void seekToFirst();
+    // Position at the first key >= target
+    void seek(uint64_t target);
+    // Check if the iterator is at a key
+    bool valid();
+    // Move to the next key
+    void next();
+
+    // Key and value of the current position, the value is read from the vLog here
+    uint64_t key();
+    std::string value();
+};
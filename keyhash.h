@@ -0,0 +1,26 @@
+#pragma once
+#include <cstdint>
+#include "MurmurHash3.h"
+
+/****************************************************************
+    Hash of a key, computed once per lookup and shared by the
+    filters of all the sstables
+    hash[0] picks the block of a blocked filter, the 32-bit
+    halves of hash[1] are h1 and h2 of double hashing,
+    probe i is h1 + i * h2
+****************************************************************/
+
+struct KeyHash {
+    uint64_t hash[2];
+
+    template <typename K>
+    explicit KeyHash(const K &key) {
+        MurmurHash3_x64_128(&key, sizeof(K), 0, hash);
+    }
+
+    uint32_t h1() const {return (uint32_t)hash[1];}
+    uint32_t h2() const {return (uint32_t)(hash[1] >> 32);}
+
+    // Position of the i-th probe
+    uint32_t probe(uint32_t i) const {return h1() + i * h2();}
+};
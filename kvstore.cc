@@ -1,16 +1,22 @@
 #include "kvstore.h"
 #include "config.h"
 #include "sstable.h"
+#include "sstbuilder.h"
 #include "utils.h"
+#include <algorithm>
 #include <cstdint>
 #include <filesystem>
 #include <string>
 #include <chrono>
+#include <cmath>
 #include <sys/types.h>
+#include <tuple>
 #include <vector>
 
-KVStore::KVStore(const std::string &dir) : KVStoreAPI(dir)
+KVStore::KVStore(const std::string &dir, const Options &options) : KVStoreAPI(dir)
 {
+	this->options = options;
+
 	// Initialize the directory and timestamp
 	this->SSTdir = dir;
 	this->vLogdir = dir + "/vLog";
@@ -19,61 +25,71 @@ KVStore::KVStore(const std::string &dir) : KVStoreAPI(dir)
 	// Read all the sstables and write them into levelIndex
 	this->sstFileCheck(this->SSTdir);
 
-	// Initialize the memtable
-	this->memtable = new MemTable();
-
-	// Initialize the vlog
-	this->vlog = new vLog(this->vLogdir);
+	// Recover the memtable which was frozen but not flushed, its operations are newer than the sstables
+	std::shared_ptr<MemTable> recovered = std::make_shared<MemTable>(immLogFilePath, this->options.walSyncMode,
+		this->options.walSyncIntervalMs, this->lastSequence);
+	this->lastSequence = recovered->getLastSequence();
+	if(!recovered->empty())
+		this->immMemtable = recovered;
 
-	// Initialize the vlog offset
-	this->curvLogOffset = 0;
+	// Initialize the memtable
+	this->memtable = std::make_shared<MemTable>(logFilePath, this->options.walSyncMode,
+		this->options.walSyncIntervalMs, this->lastSequence);
+	this->lastSequence = this->memtable->getLastSequence();
+
+	// Initialize the vlog and the cache in front of it
+	this->vlog = std::make_shared<vLog>(this->vLogdir, this->options.vLogReadMode, this->options.vLogPreallocSize);
+	this->valueCache = std::make_shared<ValueCache>(this->options.valueCacheSize);
+
+	// Readers start from the recovered state
+	std::map<uint64_t, LevelEdit> recoveredLevels;
+	for(auto level = this->levelIndex.begin(); level != this->levelIndex.end(); level++)
+		recoveredLevels[level->first].added = level->second;
+	this->installVersion(recoveredLevels);
+
+	// Initialize the rate limiter of the background writes
+	if(this->options.rateLimitBytesPerSecond > 0)
+		this->rateLimiter = new RateLimiter(this->options.rateLimitBytesPerSecond);
+	// The flushes write the vLog, charged ahead of the merges since the writers wait on them
+	this->vlog->setRateLimiter(this->rateLimiter, ratelimit_high);
+
+	// Start the flush thread, it picks up the recovered memtable at once
+	this->flushThread = std::thread(&KVStore::backgroundFlush, this);
+
+	// Start the compaction threads, they merge the levels already too large
+	for(uint64_t i = 0; i < std::max<uint64_t>(this->options.compactionThreadNum, 1); i++)
+		this->compactionThreads.push_back(std::thread(&KVStore::backgroundCompaction, this));
 }
 
 KVStore::~KVStore()
 {
-	// Store and delete the memtable
-	std::list<std::pair<uint64_t, std::string>> dataAll;
-	dataAll = this->memtable->copyAll();
+	{
+		std::unique_lock<std::mutex> lock(this->mutex);
 
-	// Write all the key-value pairs in memtable to sstable
-	if(dataAll.size() > 0){
-		// Get the current time to generate the filename
-		std::chrono::time_point<std::chrono::system_clock> now = std::chrono::system_clock::now();
-		std::chrono::microseconds nstime = std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch());
-		
-		// Update the timestamp
-		this->sstMaxTimeStamp++;
-
-		// Generate the filename
-		std::string newFilePath = this->SSTdir + "/level-0/" + std::to_string(nstime.count()) + ".sst";
-		SStable* newSSTable = new SStable(sstMaxTimeStamp, dataAll,  newFilePath, curvLogOffset);
+		// Hand the last memtable over to the flush thread
+		if(!this->memtable->empty())
+			this->freezeMemTable(lock);
 
-		// Update the levelIndex
-		this->levelIndex[0][nstime.count()] = newSSTable;
+		// Wait until everything is written to sstables
+		this->immCond.wait(lock, [this]{ return this->immMemtable == nullptr; });
+		this->stopFlush = true;
 
-		// Reset the memtable
-		this->memtable->reset();
-
-		// Compact the sstable
-		int checkResult = this->mergeCheck();
-		while(checkResult != -1){
-			this->merge(checkResult);
-			checkResult = this->mergeCheck();
-		}
+		// Wait until no level needs merging
+		this->stallCond.wait(lock, [this]{ return this->runningCompactions == 0 && this->mergeCheck() == -1; });
+		this->stopCompaction = true;
 	}
 
-	// Delete the memtable
-	delete this->memtable;
+	// Stop the flush thread
+	this->flushCond.notify_all();
+	this->flushThread.join();
 
-	// Delete all the sstables in memory
-	for(auto level = this->levelIndex.begin(); level != this->levelIndex.end(); level++){
-		for(auto sstable = level->second.begin(); sstable != level->second.end(); sstable++){
-			delete sstable->second;
-		}
-	}
+	// Stop the compaction threads
+	this->compactionCond.notify_all();
+	for(auto &thread : this->compactionThreads)
+		thread.join();
 
-	// Delete the vlog
-	delete this->vlog;
+	// The memtables, the sstables and the vlog are freed with the last version
+	delete this->rateLimiter;
 }
 
 /**
@@ -82,104 +98,265 @@ KVStore::~KVStore()
  */
 void KVStore::put(uint64_t key, const std::string &s)
 {
-	// Insert if the memtable is not full
-	if(this->memtable->putCheck(key, s)){
-		this->memtable->put(key, s);
-		return;
+	this->bytesIngested.fetch_add(sstable_keySize + s.size(), std::memory_order_relaxed);
+	this->putEntry(key, s);
+}
+
+/**
+ * Insert the key-value pair into the memtable, shared by put and the
+ * values gc moves.
+ */
+void KVStore::putEntry(uint64_t key, const std::string &s)
+{
+	std::unique_lock<std::mutex> lock(this->mutex);
+
+	// Wait for the compaction if level-0 is too large
+	this->makeRoomForWrite(lock);
+
+	// Freeze the memtable if it is full
+	if(!this->memtable->reserve(key, s)){
+		this->freezeMemTable(lock);
+		this->memtable->reserve(key, s);
 	}
-	
-	// Write the key-value pair into sstable
-	std::list<std::pair<uint64_t, std::string>> dataAll;
-	dataAll = this->memtable->copyAll();
 
-	// Get the current time to generate the filename
-	std::chrono::time_point<std::chrono::system_clock> now = std::chrono::system_clock::now();
-	std::chrono::microseconds mstime = std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch());
+	// Pin the memtable so that it is not flushed before the insert
+	std::shared_ptr<MemTable> mem = this->memtable;
+	mem->beginWrite();
+	uint64_t sequence = ++this->lastSequence;
+	lock.unlock();
 
-	// Update the timestamp
-	this->sstMaxTimeStamp++;
+	// Insert the key-value pair, concurrent writers insert in parallel
+	uint64_t lsn = mem->put(key, s, sequence);
+	std::shared_ptr<WAL> wal = mem->getWAL();
+	mem->endWrite();
 
-	// Generate the filename
-	std::string newFilePath = this->SSTdir + "/level-0/" + std::to_string(mstime.count()) + ".sst";
-	SStable* newSSTable = new SStable(sstMaxTimeStamp, dataAll,  newFilePath, curvLogOffset);
+	// Wait for the log, concurrent writers share one write
+	wal->sync(lsn);
+}
+/**
+ * Apply all the operations of the batch at once.
+ * The batch is one log record, recovery restores all of it or none.
+ * A batch larger than the free space freezes the memtable once and
+ * goes whole into the next one.
+ */
+void KVStore::write(const WriteBatch &batch)
+{
+	if(batch.empty())
+		return;
 
-	// Update the levelIndex
-	this->levelIndex[0][mstime.count()] = newSSTable;
+	uint64_t bytes = 0;
+	for(const auto &operation : batch.getOperations())
+		bytes += sstable_keySize + operation.second.size();
+	this->bytesIngested.fetch_add(bytes, std::memory_order_relaxed);
 
-	// Add the key-value pair into the vlog
-	this->vlog->readFromList(dataAll);
-	this->vlog->writeToFile(curvLogOffset);
-	this->curvLogOffset = this->vlog->getHead();
-	
-	// Reset the memtable
-	this->memtable->reset();
+	std::unique_lock<std::mutex> lock(this->mutex);
+
+	// Wait for the compaction if level-0 is too large
+	this->makeRoomForWrite(lock);
 
-	// Compact the sstable
-	int checkResult = this->mergeCheck();
-	while(checkResult != -1){
-		this->merge(checkResult);
-		checkResult = this->mergeCheck();
+	// The batch is never split across two memtables
+	if(!this->memtable->reserve(batch)){
+		this->freezeMemTable(lock);
+		this->memtable->reserve(batch, true);
 	}
 
-	// Insert the key-value pair into the memtable
-	this->memtable->put(key, s);
+	// Pin the memtable, a snapshot taken meanwhile waits for the whole batch
+	std::shared_ptr<MemTable> mem = this->memtable;
+	mem->beginWrite();
+	uint64_t sequence = this->lastSequence + 1;
+	this->lastSequence += batch.count();
+	lock.unlock();
+
+	// Insert the batch, concurrent writers insert in parallel
+	uint64_t lsn = mem->write(batch, sequence);
+	std::shared_ptr<WAL> wal = mem->getWAL();
+	mem->endWrite();
+
+	// Wait for the log, concurrent writers share one write
+	wal->sync(lsn);
 }
+
 /**
  * Returns the (string) value of the given key.
  * An empty string indicates not found.
  */
 std::string KVStore::get(uint64_t key)
 {	
-	std::string res = this->memtable->get(key);
+	// Pin the current version instead of locking the store
+	int slot;
+	Version* version = this->versions.acquire(slot);
+	std::string res = this->get(version, key, UINT64_MAX);
+	this->versions.release(version, slot);
+	return res;
+}
 
-	// If the key is deleted, return empty string
-	if(res == memtable_already_deleted)
-		return "";
+/**
+ * Returns the value of the given key as it was when the snapshot was taken.
+ * An empty string indicates not found.
+ */
+std::string KVStore::get(uint64_t key, const Snapshot* snapshot)
+{
+	int slot;
+	Version* version = this->versions.acquire(slot);
+	std::string res = this->get(version, key, snapshot->getSequence());
+	this->versions.release(version, slot);
+	return res;
+}
 
-	if(res != memtable_not_exist)
-		return res;
+/**
+ * Returns the values of the given keys, in the same order.
+ * An empty string indicates not found.
+ * All the keys are resolved in one version first, then the values
+ * missing from the cache are read in offset order, the ones close
+ * together in the vLog with one read.
+ */
+std::vector<std::string> KVStore::multiGet(const std::vector<uint64_t> &keys)
+{
+	std::vector<std::string> res(keys.size());
 
-	// Check the sstables in levelIndex
-	uint64_t latestTimeStamp = 0;
-	for(auto level = this->levelIndex.begin(); level != this->levelIndex.end(); level++){
-		bool isFound = false;
+	int slot;
+	Version* version = this->versions.acquire(slot);
 
-		// Tranverse all the sstables along the level
-		for(auto sstable = level->second.rbegin(); sstable != level->second.rend(); sstable++){
-			SStable *currentSSTable = sstable->second;
-			// Check if the key is in the sstable
-			if(currentSSTable->checkIfKeyExist(key)){
-				uint64_t indexRes = currentSSTable->getKeyIndexByKey(key);
-				// If not found, continue
-				if(indexRes == UINT64_MAX)
-					continue;
-
-				// Get the value
-				uint64_t targetOffset = currentSSTable->getSStableKeyOffset(indexRes);
-				uint32_t targetLength = currentSSTable->getSStableKeyVlen(indexRes);
-				std::string value = this->vlog->getValFromFile(this->vLogdir, targetOffset, targetLength);
-				if(value == sstable_out_of_range)
-					return "";
-				if(currentSSTable->getSStableTimeStamp() >= latestTimeStamp){
-					latestTimeStamp = currentSSTable->getSStableTimeStamp();
-					res = value;
-					isFound = true;
-				}
-			}
-		}
+	// {offset, vlen} of the values to read, and the key positions waiting for each one
+	std::vector<std::pair<std::pair<uint64_t, uint32_t>, size_t> > pending;
+	for(size_t i = 0; i < keys.size(); i++){
+		uint64_t offset;
+		uint32_t vlen;
+		if(this->locate(version, keys[i], UINT64_MAX, res[i], offset, vlen) || offset == UINT64_MAX)
+			continue;
+		if(!version->valueCache->get(offset, res[i]))
+			pending.push_back({{offset, vlen}, i});
+	}
 
-		if(isFound && res == delete_tag)
+	// Sort by offset, a value asked for by several keys is read once
+	std::sort(pending.begin(), pending.end());
+	std::vector<std::pair<uint64_t, uint32_t> > requests;
+	for(auto &entry : pending){
+		if(requests.empty() || requests.back() != entry.first)
+			requests.push_back(entry.first);
+	}
+
+	std::vector<std::string> values;
+	version->vlog->getValsFromFile(requests, values, this->options.vLogCoalesceGap);
+
+	size_t request = 0;
+	for(auto &entry : pending){
+		while(requests[request] != entry.first)
+			request++;
+		res[entry.second] = values[request];
+	}
+
+	// Errors are not cached, the range may become valid later
+	for(size_t i = 0; i < requests.size(); i++){
+		if(values[i] != sstvalue_outOfRange && values[i] != sstvalue_readFile_file)
+			version->valueCache->put(requests[i].first, values[i]);
+	}
+	this->versions.release(version, slot);
+
+	for(std::string &value : res){
+		if(value == delete_tag || value == sstvalue_outOfRange || value == sstvalue_readFile_file)
+			value = "";
+	}
+	return res;
+}
+
+/**
+ * Get the value of a key in a pinned version, skipping the versions
+ * newer than sequence.
+ */
+std::string KVStore::get(Version* version, uint64_t key, uint64_t sequence)
+{
+	std::string res;
+	uint64_t offset;
+	uint32_t vlen;
+	if(!this->locate(version, key, sequence, res, offset, vlen)){
+		if(offset == UINT64_MAX)
 			return "";
-		else if(isFound)
-			return res;
+		res = version->valueCache->read(*version->vlog, offset, vlen);
 	}
 
 	// Check the value is valid
-	if(res == delete_tag || res == memtable_not_exist)
+	if(res == delete_tag || res == sstable_out_of_range || res == sstvalue_outOfRange || res == sstvalue_readFile_file)
 		return "";
-	else
-		return res;
+	return res;
 }
+
+/**
+ * Find the newest entry of a key in a pinned version, skipping the
+ * versions newer than sequence.
+ * Returns true with the value if a memtable holds the entry, otherwise
+ * offset and vlen point at the value in the vLog, offset is UINT64_MAX
+ * if the key is not found.
+ */
+bool KVStore::locate(Version* version, uint64_t key, uint64_t sequence, std::string &value, uint64_t &offset, uint32_t &vlen)
+{
+	offset = UINT64_MAX;
+	vlen = 0;
+
+	// Check the memtable, then the immutable memtable which is being flushed
+	for(MemTable* mem : {version->memtable.get(), version->immMemtable.get()}){
+		if(mem == nullptr)
+			continue;
+		std::string res = mem->get(key, sequence);
+
+		// If the key is deleted, return the tombstone
+		if(res == memtable_already_deleted){
+			value = delete_tag;
+			return true;
+		}
+		if(res != memtable_not_exist){
+			value = res;
+			return true;
+		}
+	}
+
+	// Check the sstables of the levels, the key is hashed once for all the filters
+	KeyHash keyHash(key);
+	for(auto level = version->levels->begin(); level != version->levels->end(); level++){
+		// A level >= 1 has one candidate sstable, found by binary search on the fences
+		const LevelFences* fences = level->second->getFences();
+		if(fences != nullptr){
+			SStable *currentSSTable = Version::findSStable(*fences, key);
+			if(currentSSTable == nullptr || !currentSSTable->checkIfKeyExist(key, keyHash))
+				continue;
+
+			uint64_t indexRes = currentSSTable->getKeyIndexByKey(key, sequence);
+			if(indexRes == UINT64_MAX)
+				continue;
+
+			offset = currentSSTable->getSStableKeyOffset(indexRes);
+			vlen = currentSSTable->getSStableKeyVlen(indexRes);
+			return false;
+		}
+
+		// Tranverse all the sstables along the level, the largest sequence number is the newest,
+		// then the largest timestamp, then the largest file id
+		std::tuple<uint64_t, uint64_t, uint64_t> latest(0, 0, 0);
+		for(auto sstable = level->second->sstables.rbegin(); sstable != level->second->sstables.rend(); sstable++){
+			SStable *currentSSTable = sstable->second.get();
+			// Check if the key is in the sstable
+			if(!currentSSTable->checkIfKeyExist(key, keyHash))
+				continue;
+			uint64_t indexRes = currentSSTable->getKeyIndexByKey(key, sequence);
+			// If not found, continue
+			if(indexRes == UINT64_MAX)
+				continue;
+
+			std::tuple<uint64_t, uint64_t, uint64_t> current(currentSSTable->getSStableKeySeq(indexRes),
+				currentSSTable->getSStableTimeStamp(), sstable->first);
+			if(offset == UINT64_MAX || current > latest){
+				latest = current;
+				offset = currentSSTable->getSStableKeyOffset(indexRes);
+				vlen = currentSSTable->getSStableKeyVlen(indexRes);
+			}
+		}
+
+		if(offset != UINT64_MAX)
+			return false;
+	}
+	return false;
+}
+
 /**
  * Delete the given key-value pair if it exists.
  * Returns false iff the key is not found.
@@ -198,21 +375,34 @@ bool KVStore::del(uint64_t key)
  */
 void KVStore::reset()
 {
-	// Delete the memtable
-	utils::rmfile(logFilePath);
-	this->memtable->reset();
+	std::unique_lock<std::mutex> lock(this->mutex);
+
+	// Wait for the flush thread to finish the immutable memtable
+	this->immCond.wait(lock, [this]{ return this->immMemtable == nullptr; });
+	// Wait for the running merges, they own some of the sstables
+	this->stallCond.wait(lock, [this]{ return this->runningCompactions == 0; });
+
+	// Drop the log and start a new memtable, readers may still hold the old one
+	this->memtable->dropLog();
+	this->memtable = std::make_shared<MemTable>(logFilePath, this->options.walSyncMode, this->options.walSyncIntervalMs);
 	
-	// Delete all the sstables in memory
+	// Delete all the sstable files, the objects are freed with the last version
 	for(auto level = this->levelIndex.begin(); level != this->levelIndex.end(); level++){
 		for(auto sstable = level->second.begin(); sstable != level->second.end(); sstable++){
 			sstable->second->clear();
-			delete sstable->second;
 		}
 	}
 	this->levelIndex.clear();
-
-	// Delete the vlog
-	delete this->vlog;
+	this->levels = std::make_shared<const Levels>();
+
+	// Start a new vlog, the old one is closed with the last version holding it
+	// The new vLog reuses the offsets, so it gets an empty cache of its own that
+	// the readers of the old one cannot fill
+	utils::rmfile(this->vLogdir);
+	this->vlog = std::make_shared<vLog>(this->vLogdir, this->options.vLogReadMode, this->options.vLogPreallocSize);
+	this->vlog->setRateLimiter(this->rateLimiter, ratelimit_high);
+	this->valueCache = std::make_shared<ValueCache>(this->options.valueCacheSize);
+	this->installVersion();
 }
 
 /**
@@ -222,32 +412,73 @@ void KVStore::reset()
  */
 void KVStore::scan(uint64_t key1, uint64_t key2, std::list<std::pair<uint64_t, std::string>> &list)
 {
-	// scanMap[key][timestamp] = value
-	std::map<uint64_t, std::map<uint64_t, std::string> > scanMap;
-	std::list<std::pair<uint64_t, std::string> >mergeList;
+	this->scan(key1, key2, list, nullptr);
+}
 
-	// Scan the sstables in levelIndex
-	for(auto level = this->levelIndex.begin(); level != this->levelIndex.end(); level++){
-		for(auto sstable = level->second.begin(); sstable != level->second.end(); sstable++){
-			SStable *currentSSTable = sstable->second;
-			currentSSTable->scan(key1, key2, scanMap, *this->vlog);
-		}
-	}
+/**
+ * Same as scan, as the store was when the snapshot was taken.
+ * A null snapshot reads the latest values.
+ */
+void KVStore::scan(uint64_t key1, uint64_t key2, std::list<std::pair<uint64_t, std::string>> &list, const Snapshot* snapshot)
+{
+	// Merge the memtables and the sstables in key order, the values are read as they are listed
+	Iterator* iter = this->newIterator(key2, snapshot);
+	for(iter->seek(key1); iter->valid(); iter->next())
+		list.push_back({iter->key(), iter->value()});
+	delete iter;
+}
 
-	for(auto iter = scanMap.begin(); iter != scanMap.end(); iter++){
-		uint64_t key = iter->first;
-		for(auto iter2 = iter->second.begin(); iter2 != iter->second.end(); iter2++){
-			list.push_back({key, iter2->second});
-		}
-	}
+/**
+ * Return an iterator over the key-value pairs with keys up to upperBound,
+ * in ascending order, as seen by the snapshot if one is given. It pins the
+ * current memtables and sstables until it is deleted, and it must be
+ * deleted before the store.
+ */
+Iterator* KVStore::newIterator(uint64_t upperBound, const Snapshot* snapshot)
+{
+	uint64_t sequence = (snapshot != nullptr) ? snapshot->getSequence() : UINT64_MAX;
+	return new Iterator(this, upperBound, sequence);
+}
 
-	// Scan the memtable
-	this->memtable->scan(key1, key2, mergeList);
+/**
+ * Take a snapshot of the store. The reads given it see the puts and dels
+ * done before, compaction keeps the versions they need until the snapshot
+ * is released. Writers only wait for the puts already under way.
+ */
+const Snapshot* KVStore::getSnapshot()
+{
+	std::unique_lock<std::mutex> lock(this->mutex);
 
-	// Merge the list
-	for(auto iter = mergeList.begin(); iter != mergeList.end(); iter++){
-		list.push_back({iter->first, iter->second});
+	// The puts given a sequence number so far may still be inserting, wait for them
+	// New ones are held off by the lock
+	this->memtable->waitForWriters();
+	if(this->immMemtable != nullptr)
+		this->immMemtable->waitForWriters();
+
+	this->snapshots.insert(this->lastSequence);
+	return new Snapshot(this->lastSequence);
+}
+
+/**
+ * Release a snapshot taken by getSnapshot, the versions only it needs
+ * are dropped by the next compactions.
+ */
+void KVStore::releaseSnapshot(const Snapshot* snapshot)
+{
+	{
+		std::unique_lock<std::mutex> lock(this->mutex);
+		this->snapshots.erase(this->snapshots.find(snapshot->getSequence()));
 	}
+	delete snapshot;
+}
+
+/**
+ * Sorted sequence numbers of the live snapshots.
+ */
+std::vector<uint64_t> KVStore::liveSnapshots()
+{
+	std::unique_lock<std::mutex> lock(this->mutex);
+	return std::vector<uint64_t>(this->snapshots.begin(), this->snapshots.end());
 }
 
 /**
@@ -261,72 +492,499 @@ void KVStore::sstFileCheck(std::string dataPath){
 		return;
 	}
 
-	// Check all the sstables in the directory
-	for(auto &p : std::filesystem::directory_iterator(dataPath)){
-		std::string filePath = p.path();
-		std::string fileName = p.path().filename();
-		std::string level = fileName.substr(6, 1);
-		std::string timestamp = fileName.substr(0, fileName.size() - 4);
-		uint64_t timestampInt = std::stoull(timestamp);
+	// Check all the level directories in the directory
+	for(auto &levelDir : std::filesystem::directory_iterator(dataPath)){
+		std::string dirName = levelDir.path().filename();
+
+		// Skip the vlog and other files
+		if(!levelDir.is_directory() || dirName.substr(0, 6) != "level-")
+			continue;
+		uint64_t level = std::stoull(dirName.substr(6));
+
+		// Check all the sstables in the level
+		for(auto &p : std::filesystem::directory_iterator(levelDir.path())){
+			std::string filePath = p.path();
+			if(p.path().extension() != ".sst")
+				continue;
+			// The file is named by its file id
+			uint64_t fileID = std::stoull(p.path().stem().string());
+
+			// Read the sstable
+			std::shared_ptr<SStable> newSSTable = std::make_shared<SStable>(filePath);
+			this->levelIndex[level][fileID] = newSSTable;
+
+			// Update the timestamp, the sequence number and the file id
+			this->sstMaxTimeStamp = std::max(newSSTable->getSStableTimeStamp(), this->sstMaxTimeStamp);
+			this->lastSequence = std::max(newSSTable->getSStableMaxSeq(), this->lastSequence);
+			this->lastFileID = std::max<uint64_t>(fileID, this->lastFileID);
+		}
+	}
+}
+
+/**
+ * Hand the full memtable over to the flush thread.
+ * The caller holds the lock, which is released while waiting for
+ * the previous immutable memtable to be flushed.
+ */
+void KVStore::freezeMemTable(std::unique_lock<std::mutex> &lock){
+	// Only one immutable memtable is kept at a time
+	this->immCond.wait(lock, [this]{ return this->immMemtable == nullptr; });
+
+	// Freeze the memtable together with its log
+	this->memtable->moveLog(immLogFilePath);
+	this->immMemtable = this->memtable;
+
+	// Foreground writes go into a fresh memtable
+	this->memtable = std::make_shared<MemTable>(logFilePath, this->options.walSyncMode, this->options.walSyncIntervalMs);
+	this->installVersion();
+
+	// Wake the flush thread
+	this->flushCond.notify_one();
+}
+
+/**
+ * Persist the immutable memtable to level-0 and the vLog.
+ * Runs on the flush thread without holding the lock.
+ */
+void KVStore::flushMemTable(std::shared_ptr<MemTable> imm){
+	// The writers pinned the memtable before it was frozen
+	imm->waitForWriters();
+
+	// Keep the older versions the live snapshots see, the ones taken later see the newest
+	std::vector<uint64_t> sequences;
+	std::list<std::pair<uint64_t, std::string>> dataAll;
+	dataAll = imm->copyAll(this->liveSnapshots(), sequences);
+
+	std::shared_ptr<SStable> newSSTable = nullptr;
+	uint64_t fileID = 0;
+
+	if(dataAll.size() > 0){
+		// Add the key-value pairs into the vlog first, the sstable points at them
+		this->vlog->readFromList(dataAll);
+		uint64_t writeOffset = this->vlog->writeToFile();
+
+		// Create level-0 if it does not exist
+		std::string levelPath = this->SSTdir + "/level-0";
+		if(!utils::dirExists(levelPath))
+			utils::mkdir(levelPath);
 
-		// Read the sstable
-		SStable* newSSTable = new SStable(filePath);
-		this->levelIndex[std::stoi(level)][timestampInt] = newSSTable;
+		// Get a unique id to generate the filename
+		fileID = this->newFileID();
 
 		// Update the timestamp
-		this->sstMaxTimeStamp = std::max(newSSTable->getSStableTimeStamp(), this->sstMaxTimeStamp);
+		this->sstMaxTimeStamp++;
+
+		// Charge the sstable before it is written, the vLog charged its values burst by burst
+		double bitsPerKey = this->filterBitsPerKey(0);
+		if(this->rateLimiter != nullptr)
+			this->rateLimiter->request(SStable::estimateFileSize(dataAll.size(), this->options.filterFormat,
+				bitsPerKey, this->options.rangeFilterBitsPerPrefix), ratelimit_high);
+
+		// Generate the filename
+		std::string newFilePath = levelPath + "/" + std::to_string(fileID) + ".sst";
+		newSSTable = std::make_shared<SStable>(sstMaxTimeStamp, dataAll, sequences, newFilePath, writeOffset,
+			this->options.filterFormat, bitsPerKey, this->options.rangeFilterBitsPerPrefix);
+		uint64_t bytesWritten = this->vlog->getHead() - writeOffset + newSSTable->getSStableFileSize();
+		this->flushBytesWritten.fetch_add(bytesWritten, std::memory_order_relaxed);
 	}
+
+	std::unique_lock<std::mutex> lock(this->mutex);
+
+	// Publish the sstable and drop the immutable memtable together
+	std::map<uint64_t, LevelEdit> edits;
+	if(newSSTable != nullptr){
+		this->levelIndex[0][fileID] = newSSTable;
+		edits[0].added[fileID] = newSSTable;
+	}
+	imm->dropLog();
+	this->immMemtable = nullptr;
+	this->installVersion(edits);
+
+	// Let the compaction threads check the levels
+	this->compactionCond.notify_all();
 }
 
 /**
- * Check if the sstable in each level needs to be merged
+ * Main loop of the flush thread
  */
-uint64_t KVStore::mergeCheck(){
+void KVStore::backgroundFlush(){
+	while(true){
+		std::shared_ptr<MemTable> imm = nullptr;
+		{
+			std::unique_lock<std::mutex> lock(this->mutex);
+			this->flushCond.wait(lock, [this]{ return this->stopFlush || this->immMemtable != nullptr; });
+
+			// Exit only when nothing is left to flush
+			if(this->immMemtable == nullptr)
+				return;
+			imm = this->immMemtable;
+		}
+
+		this->flushMemTable(imm);
+		imm = nullptr;
+
+		// Wake the writers waiting for the immutable memtable
+		this->immCond.notify_all();
+	}
+}
+
+/**
+ * Pick the level with the highest score over 1, see levelScore.
+ * Levels already being merged are skipped.
+ * Return -1 if no level needs to be merged.
+ */
+int KVStore::mergeCheck(){
+	int pickLevel = -1;
+	double pickScore = 1;
+
+	uint64_t baseLevel;
+	std::vector<double> targets = this->levelTargetBytes(*this->levels, 0, baseLevel);
+
 	// Check if the sstable in each level needs to be merged
-	for(auto level = this->levelIndex.begin(); level != this->levelIndex.end(); level++){
+	for(auto level = this->levels->begin(); level != this->levels->end(); level++){
 		// Get the level
 		int levelNum = level->first;
 
-		// Check if the sstable in the level is full
-		if(level->second.size() > level_max_file_num(levelNum)){
-			return level->first;
+		// Skip the level if it or the level it merges into is being merged
+		if(this->busyLevels.count(levelNum) || this->busyLevels.count(this->mergeOutputLevel(levelNum, baseLevel)))
+			continue;
+
+		// Pick the level most out of its limitation
+		double score = this->levelScore(levelNum, *level->second, targets);
+		if(score > pickScore){
+			pickScore = score;
+			pickLevel = levelNum;
+		}
+	}
+	return pickLevel;
+}
+
+/**
+ * Score of a level: level-0 file num against level0CompactionTrigger,
+ * the bytes of a deeper level against its target, or in tiered mode
+ * sorted runs against tieredSizeRatio.
+ */
+double KVStore::levelScore(uint64_t levelNum, const LevelFiles &level, const std::vector<double> &targets){
+	if(this->options.compactionStyle == compaction_tiered)
+		return (double)level.sortedRunNum / this->options.tieredSizeRatio;
+	if(levelNum == 0)
+		return (double)level.sstables.size() / this->options.level0CompactionTrigger;
+	return (levelNum < targets.size()) ? level.bytes / targets[levelNum] : 0;
+}
+
+/**
+ * Bytes the levels hold over their limitations, the share of a
+ * level's bytes its score is over 1.
+ */
+double KVStore::compactionDebt(){
+	uint64_t baseLevel;
+	std::vector<double> targets = this->levelTargetBytes(*this->levels, 0, baseLevel);
+
+	double debt = 0;
+	for(auto level = this->levels->begin(); level != this->levels->end(); level++){
+		double score = this->levelScore(level->first, *level->second, targets);
+		if(score > 1)
+			debt += level->second->bytes * (1 - 1 / score);
+	}
+	return debt;
+}
+
+/**
+ * Give the merges more bandwidth while they fall behind: the rate
+ * grows by one configured rate per levelBaseBytes of compaction debt,
+ * up to ratelimit_max_boost times, and falls back once it is paid.
+ */
+void KVStore::tuneRateLimiter(){
+	if(this->rateLimiter == nullptr || !this->options.rateLimitAutoTune)
+		return;
+
+	double boost = 1 + this->compactionDebt() / std::max<uint64_t>(this->options.levelBaseBytes, 1);
+	boost = std::min<double>(boost, ratelimit_max_boost);
+	this->rateLimiter->setBytesPerSecond(this->options.rateLimitBytesPerSecond * boost);
+}
+
+/**
+ * Main loop of a compaction thread
+ */
+void KVStore::backgroundCompaction(){
+	std::unique_lock<std::mutex> lock(this->mutex);
+
+	while(true){
+		int level = -1;
+		this->compactionCond.wait(lock, [this, &level]{
+			return this->stopCompaction || (level = this->mergeCheck()) != -1;
+		});
+
+		if(level == -1)
+			return;
+		this->tuneRateLimiter();
+
+		uint64_t baseLevel;
+		this->levelTargetBytes(*this->levels, 0, baseLevel);
+		uint64_t outputLevel = this->mergeOutputLevel(level, baseLevel);
+
+		// Own level X and the level it merges into during the merge
+		this->busyLevels.insert(level);
+		this->busyLevels.insert(outputLevel);
+		this->runningCompactions++;
+
+		lock.unlock();
+		this->merge(level, outputLevel);
+		lock.lock();
+
+		this->busyLevels.erase(level);
+		this->busyLevels.erase(outputLevel);
+		this->runningCompactions--;
+		this->tuneRateLimiter();
+
+		// The next level may be too large now, and the writers may go on
+		this->compactionCond.notify_all();
+		this->stallCond.notify_all();
+	}
+}
+
+/**
+ * Delay the writer once when level-0 reaches the slowdown trigger,
+ * and stop it while level-0 is at the stop trigger.
+ */
+void KVStore::makeRoomForWrite(std::unique_lock<std::mutex> &lock){
+	bool isDelayed = false;
+
+	while(true){
+		auto level0 = this->levelIndex.find(0);
+		uint64_t level0FileNum = (level0 == this->levelIndex.end()) ? 0 : level0->second.size();
+
+		if(level0FileNum >= this->options.level0StopTrigger){
+			// Wait for a merge to finish
+			this->stallCond.wait(lock);
+		} else if(!isDelayed && level0FileNum >= this->options.level0SlowdownTrigger){
+			// Give the compaction threads some time
+			lock.unlock();
+			std::this_thread::sleep_for(std::chrono::microseconds(this->options.slowdownDelayMicros));
+			lock.lock();
+			isDelayed = true;
+		} else {
+			break;
+		}
+	}
+}
+
+/**
+ * Get a unique id for a new sstable file.
+ * The id is the current time in microseconds, bumped if already used.
+ */
+uint64_t KVStore::newFileID(){
+	std::chrono::time_point<std::chrono::system_clock> now = std::chrono::system_clock::now();
+	std::chrono::microseconds mstime = std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch());
+
+	uint64_t lastID = this->lastFileID;
+	uint64_t newID = std::max<uint64_t>(mstime.count(), lastID + 1);
+	while(!this->lastFileID.compare_exchange_weak(lastID, newID))
+		newID = std::max<uint64_t>(mstime.count(), lastID + 1);
+	return newID;
+}
+
+/**
+ * Filter bits per key of a new sstable in the level.
+ * With filterPerLevel the budget is split as in Monkey: the false positive
+ * rate of a level is proportional to its size, so the shallow levels that
+ * every lookup probes but that hold few keys get more bits per key.
+ */
+double KVStore::filterBitsPerKey(uint64_t level){
+	if(!this->options.filterPerLevel)
+		return this->options.filterBitsPerKey;
+
+	// The target bytes of each level down to the deepest one holding sstables in the current version
+	int slot;
+	Version* version = this->versions.acquire(slot);
+	uint64_t baseLevel;
+	std::vector<double> caps = this->levelTargetBytes(*version->levels, level, baseLevel);
+	this->versions.release(version, slot);
+	uint64_t lastLevel = caps.size() - 1;
+
+	// Level i holds the share w_i of the keys and gets bitsL + ln(cap_L / cap_i) / ln2^2 bits per key,
+	// bitsL keeps the average at filterBitsPerKey
+	const double ln2Square = M_LN2 * M_LN2;
+	double totalCap = 0;
+	for(uint64_t i = 0; i <= lastLevel; i++)
+		totalCap += caps[i];
+
+	double extraBits = 0;
+	for(uint64_t i = 0; i <= lastLevel; i++)
+		extraBits += caps[i] / totalCap * std::log(caps[lastLevel] / caps[i]) / ln2Square;
+
+	double bitsL = this->options.filterBitsPerKey - extraBits;
+	return std::max(1.0, bitsL + std::log(caps[lastLevel] / caps[level]) / ln2Square);
+}
+
+/**
+ * Target bytes of the levels 0 to the last one, or to minLastLevel if
+ * it is deeper.
+ * The last level is levelNum - 1, or a deeper one holding sstables. It
+ * is as large as it is, each level above it is levelFanout times
+ * smaller, up to the base level whose target is still levelBaseBytes
+ * or more. Level-0 merges into the base level, the levels between them
+ * are left empty and are only given small targets to drain what they
+ * still hold. The base level moves up as the last level grows.
+ * Level-0 is given the bytes of level0CompactionTrigger full sstables.
+ */
+std::vector<double> KVStore::levelTargetBytes(const Levels &levels, uint64_t minLastLevel, uint64_t &baseLevel){
+	uint64_t lastLevel = std::max<uint64_t>(this->options.levelNum, 2) - 1;
+	for(auto iter = levels.rbegin(); iter != levels.rend(); iter++){
+		if(iter->first > 0){
+			lastLevel = std::max(lastLevel, iter->first);
+			break;
+		}
+	}
+
+	std::vector<double> targets(std::max(lastLevel, minLastLevel) + 1, 0);
+	auto last = levels.find(lastLevel);
+	double fanout = std::max<uint64_t>(this->options.levelFanout, 2);
+	double target = std::max<double>(this->options.levelBaseBytes, last == levels.end() ? 0 : last->second->bytes);
+
+	baseLevel = lastLevel;
+	targets[lastLevel] = target;
+	while(baseLevel > 1 && target / fanout >= this->options.levelBaseBytes){
+		target /= fanout;
+		targets[--baseLevel] = target;
+	}
+	for(uint64_t i = baseLevel - 1; i >= 1; i--)
+		targets[i] = targets[i + 1] / fanout;
+	targets[0] = this->options.level0CompactionTrigger * sstable_maxSize;
+
+	// A level below the deepest one may take all of it
+	for(uint64_t i = lastLevel + 1; i < targets.size(); i++)
+		targets[i] = targets[i - 1] * fanout;
+	return targets;
+}
+
+/**
+ * Level the sstables of a level are merged into.
+ * Level-0 goes to the base level, unless a level above it holds sstables,
+ * which must stay below the level-0 ones. The caller holds the lock.
+ */
+uint64_t KVStore::mergeOutputLevel(uint64_t level, uint64_t baseLevel){
+	if(level > 0 || this->options.compactionStyle == compaction_tiered)
+		return level + 1;
+
+	uint64_t outputLevel = 1;
+	while(outputLevel < baseLevel){
+		auto iter = this->levelIndex.find(outputLevel);
+		if(iter != this->levelIndex.end() && iter->second.size() > 0)
+			break;
+		outputLevel++;
+	}
+	return outputLevel;
+}
+
+/**
+ * Publish the memtables and levelIndex as the version new readers see.
+ * Only the edited levels are rebuilt, from the same level of the last
+ * version, the others are shared with it, so a memtable switch copies
+ * no sstable.
+ * Called with the store mutex held after each change.
+ */
+void KVStore::installVersion(const std::map<uint64_t, LevelEdit> &edits){
+	if(!edits.empty()){
+		std::shared_ptr<Levels> levels = std::make_shared<Levels>(*this->levels);
+		for(auto edit = edits.begin(); edit != edits.end(); edit++){
+			auto base = levels->find(edit->first);
+			auto files = std::make_shared<const LevelFiles>(edit->first,
+				base == levels->end() ? nullptr : base->second.get(), edit->second,
+				this->options.compactionStyle == compaction_tiered);
+			if(files->sstables.empty() && files->getFences() == nullptr)
+				levels->erase(edit->first);
+			else
+				(*levels)[edit->first] = files;
 		}
+		this->levels = levels;
 	}
-	return -1;
+	this->versions.install(new Version(this->memtable, this->immMemtable, this->levels, this->vlog, this->valueCache));
 }
 
 /**
- * Merge the sstable in the given two levelw
+ * Position of a merge in one of its input sstables.
  */
-void KVStore::merge(uint64_t level){
+struct MergeCursor {
+	SStable* sstable;
+	// Next entry and the end of the key range
+	uint64_t pos;
+	uint64_t end;
+	// Order of the versions of a key across the inputs
+	bool isLevelX;
+	uint64_t timeStamp;
+	uint64_t fileID;
+};
+
+/**
+ * Order of the merge heap, the smallest key comes first, then the newest version.
+ * The sequence number orders the versions of a key, it is 0 in the sstables written before it.
+ * Those go by level, then timestamp: the output of a merge takes the largest timestamp of its
+ * inputs, so a level X+1 sstable can have the timestamp of newer values in level X.
+ */
+static bool mergeCursorAfter(const MergeCursor &a, const MergeCursor &b){
+	uint64_t keyA = a.sstable->getSStableKey(a.pos), keyB = b.sstable->getSStableKey(b.pos);
+	if(keyA != keyB)
+		return keyA > keyB;
+	return std::make_tuple(a.sstable->getSStableKeySeq(a.pos), a.isLevelX, a.timeStamp, a.fileID)
+		< std::make_tuple(b.sstable->getSStableKeySeq(b.pos), b.isLevelX, b.timeStamp, b.fileID);
+}
+
+/**
+ * Hand the versions kept of a key to the builder.
+ * In the bottom level the oldest versions are dropped while they are
+ * deleted, no older version is left for the tombstone to hide.
+ */
+static void addKeyVersions(SStableBuilder &builder, std::vector<IndexEntry> &versions, bool isBottomLevel, vLog* vlog){
+	while(isBottomLevel && !versions.empty()){
+		IndexEntry &oldest = versions.back();
+		if(oldest.vlen != sizeof(delete_tag) - 1 || vlog->getValFromFile(oldest.offset, oldest.vlen) != delete_tag)
+			break;
+		versions.pop_back();
+	}
+
+	for(const IndexEntry &entry : versions)
+		builder.add(entry);
+	versions.clear();
+}
+
+/**
+ * Merge the sstables of a level into the output level, the levels
+ * between them are empty.
+ */
+void KVStore::merge(uint64_t level, uint64_t outputLevel){
+	std::unique_lock<std::mutex> lock(this->mutex);
+
 	// Check if the target level exists
-	if(level >= this->levelIndex.size()-1){
+	std::string levelPath = this->SSTdir + "/level-" + std::to_string(outputLevel);
+	if(!utils::dirExists(levelPath)){
 		// Create a new level
-		std::string levelPath = this->SSTdir + "/level-" + std::to_string(level+1);
-		utils::mkdir(levelPath.c_str());
+		utils::mkdir(levelPath);
 	}
 	
 	/*
 		Step1: select sstables in level X
 	*/
-	std::map<uint64_t, std::map<uint64_t, SStable*> > sstableSelect;
+	std::map<uint64_t, std::map<uint64_t, std::shared_ptr<SStable> > > sstableSelect;
 
-	if(level == 0){
-		// Select the sstables in level 0
-		for(auto sstable = this->levelIndex[0].begin(); sstable != this->levelIndex[0].end(); sstable++){
+	if(level == 0 || this->options.compactionStyle == compaction_tiered){
+		// Select the sstables in level 0, or all the sorted runs of a tiered level
+		for(auto sstable = this->levelIndex[level].begin(); sstable != this->levelIndex[level].end(); sstable++){
 			sstableSelect[level][sstable->first] = sstable->second;
 		}
 	} else if(level > 0){
-		uint64_t selectNum = levelIndex[level].size() - level_max_file_num(level);
-		uint64_t alreadyChooseNum = 0;
+		// Select the oldest sstables until the rest fits the target bytes of the level
+		uint64_t baseLevel;
+		double targetBytes = this->levelTargetBytes(*this->levels, level, baseLevel)[level];
+		double restBytes = this->levels->at(level)->bytes;
 
 		// Sort the sstables in the level by timestamp
 		std::map<uint64_t, std::map<uint64_t, SStable*> > sortMap;
 		std::map<uint64_t, std::map<uint64_t, uint64_t> > sstableName;
 
 		for(auto sstable = this->levelIndex[level].begin(); sstable != this->levelIndex[level].end(); sstable++){
-			// sstable->first = timestamp
-			SStable *curTable = sstable->second;
+			// sstable->first = file id
+			SStable *curTable = sstable->second.get();
 			uint64_t curTimeStamp = curTable->getSStableTimeStamp();
 			uint64_t minKey = curTable->getSStableMinKey();
 
@@ -336,20 +994,21 @@ void KVStore::merge(uint64_t level){
 
 		for(auto iterX = sortMap.begin(); iterX != sortMap.end(); iterX++){
 			for(auto iterY = iterX->second.begin(); iterY != iterX->second.end(); iterY++){
-				if(alreadyChooseNum < selectNum){
+				if(sstableSelect[level].empty() || restBytes > targetBytes){
 					uint64_t curFileID = sstableName[iterX->first][iterY->first];
 
-					sstableSelect[level][curFileID] = iterY->second;
-					alreadyChooseNum++;
+					sstableSelect[level][curFileID] = this->levelIndex[level][curFileID];
+					restBytes -= iterY->second->getSStableSize();
 				}
 			}
 		}
 	}
 
 	/*
-		Step2: select sstables in level X+1
+		Step2: select sstables in the output level
 	*/
-	if(sstableSelect[level].size() > 0){
+	// A tiered merge adds a new sorted run to the output level and leaves the runs there alone
+	if(sstableSelect[level].size() > 0 && this->options.compactionStyle == compaction_leveled){
 		// Get the minKey and maxKey of selected sstables in level X
 		uint64_t LevelXminKey = UINT64_MAX;
 		uint64_t LevelXmaxKey = 0;
@@ -359,213 +1018,284 @@ void KVStore::merge(uint64_t level){
 			LevelXmaxKey = std::max(LevelXmaxKey, sstable->second->getSStableMaxKey());
 		}
 
-		// Tranverse level X+1 to find the sstables that need to be merged
-		for(auto iter = levelIndex[level+1].begin(); iter != levelIndex[level].end(); iter++){
-			
-			SStable *curTable = iter->second;
-			uint64_t curMinKey = curTable->getSStableMinKey();
-			uint64_t curMaxKey = curTable->getSStableMaxKey();
+		// Find the overlapping sstables of a sorted output level on its fences
+		auto outputFiles = this->levels->find(outputLevel);
+		const LevelFences* fences = (outputFiles == this->levels->end()) ? nullptr : outputFiles->second->getFences();
+		if(fences != nullptr){
+			for(size_t i = Version::seekFence(*fences, LevelXminKey); i < fences->size(); i++){
+				const FencePointer &fence = fences->at(i);
+				if(fence.minKey > LevelXmaxKey)
+					break;
+				sstableSelect[outputLevel][fence.fileID] = fence.sstable;
+			}
+		} else {
+			// Tranverse the output level to find the sstables that need to be merged
+			for(auto iter = levelIndex[outputLevel].begin(); iter != levelIndex[outputLevel].end(); iter++){
 
-			// Insert to the sstableSelect if the key is covered
-			if(curMinKey >= LevelXminKey && curMaxKey <= LevelXmaxKey){
-				sstableSelect[level+1][iter->first] = curTable;
+				SStable *curTable = iter->second.get();
+				uint64_t curMinKey = curTable->getSStableMinKey();
+				uint64_t curMaxKey = curTable->getSStableMaxKey();
+
+				// Insert to the sstableSelect if the key range overlaps
+				if(curMaxKey >= LevelXminKey && curMinKey <= LevelXmaxKey){
+					sstableSelect[outputLevel][iter->first] = iter->second;
+				}
 			}
 		}
 	}
 
+	// Deleted keys can be dropped if no deeper level holds older values
+	bool isBottomLevel = true;
+	for(auto iter = this->levelIndex.upper_bound(outputLevel); iter != this->levelIndex.end(); iter++){
+		if(iter->second.size() > 0)
+			isBottomLevel = false;
+	}
+	// The older runs of a tiered output level overlap the new one
+	if(this->options.compactionStyle == compaction_tiered && this->levelIndex[outputLevel].size() > 0)
+		isBottomLevel = false;
+
+	// Versions between two live snapshots are dropped
+	std::vector<uint64_t> snapshots(this->snapshots.begin(), this->snapshots.end());
+
+	// The selected sstables are owned by this compaction until they are replaced
+	lock.unlock();
+
 	/*
 		Step3: merge the sstables selected
 	*/
-	// mergeList[timestamp] = sstable*
-	std::vector<SStable*> mergeList;
-
-	// sortMap[key][timestamp] = {vlen, offset}
-	std::map<uint64_t, std::map<uint64_t, std::map<uint64_t, uint32_t>> > sortMap;
-
-	// Merge the sstables
+	// The new sstables take the largest timestamp of the inputs
 	uint64_t WriteTimeStamp = 0;
-
-	// Put the sstables in the mergeList and get the WriteTimeStamp
-	for(auto iterX = sstableSelect.rbegin(); iterX != sstableSelect.rend(); iterX++){
-		for(auto iterY = sstableSelect[iterX->first].rbegin(); iterY != sstableSelect[iterX->first].rend(); iterY++){
-				SStable *curTable = iterY->second;
-				mergeList.push_back(curTable);
-				WriteTimeStamp = std::max(curTable->getSStableTimeStamp(), WriteTimeStamp);
-		}
+	for(auto iterX = sstableSelect.begin(); iterX != sstableSelect.end(); iterX++){
+		for(auto iterY = iterX->second.begin(); iterY != iterX->second.end(); iterY++)
+			WriteTimeStamp = std::max(iterY->second->getSStableTimeStamp(), WriteTimeStamp);
 	}
 
-	// Get all index entries in selected sstables
-	for(uint64_t i = 0; i < sstableSelect.size(); i++){
-		// iter[timestamp] = sstable*
-		SStable *curtable = mergeList[i];
-		uint64_t KVNum = curtable->getSStableKeyValNum();
-		for(uint64_t i = 0; i < KVNum; i++){
-			uint64_t curKey = curtable->getSStableKey(i);
-			uint64_t curOffset = curtable->getSStableKeyOffset(i);
-			uint32_t curVlen = curtable->getSStableKeyVlen(i);
-			uint64_t curTimeStamp = curtable->getSStableTimeStamp();
-
-			sortMap[curKey][curTimeStamp][curVlen] = curOffset;
-		}
+	// Split the keys into disjoint ranges at the boundaries of the output level sstables,
+	// or of the level X ones if none is merged, the ranges hold about the same number of them
+	std::vector<uint64_t> boundaries;
+	uint64_t boundaryLevel = sstableSelect[outputLevel].empty() ? level : outputLevel;
+	for(auto iter = sstableSelect[boundaryLevel].begin(); iter != sstableSelect[boundaryLevel].end(); iter++){
+		if(iter->second->getSStableMinKey() > 0)
+			boundaries.push_back(iter->second->getSStableMinKey());
 	}
-
-	// Reprocess the sortMap to remove the deleted key
-	std::map<uint64_t, std::map<uint64_t, std::map<uint64_t, uint32_t>> > sortMapProcessed;
-
-	for(auto iterX = sortMap.begin(); iterX != sortMap.end(); iterX++){
-		auto iterY = iterX->second.end();
-		// iterY[timestamp] = {offset, vlen}
-		iterY--;
-		// iterZ[vlen] = offset
-		auto iterZ = iterY->second.end();
-
-		// Skip the deleted key in the bottom level
-		if(iterZ->second == 0 && levelIndex[level+2].size() == 0)
-			continue;
-
-		// sortMapProcessed[key][timestamp][offset] = vlen
-		sortMapProcessed[iterX->first][iterY->first][iterZ->first] = iterZ->second;
+	std::sort(boundaries.begin(), boundaries.end());
+	boundaries.erase(std::unique(boundaries.begin(), boundaries.end()), boundaries.end());
+
+	uint64_t rangeNum = std::max<uint64_t>(1, std::min<uint64_t>(this->options.maxSubcompactions, boundaries.size()));
+	std::vector<uint64_t> firstKeys = {0};
+	for(uint64_t i = 1; i < rangeNum; i++)
+		firstKeys.push_back(boundaries[i * boundaries.size() / rangeNum]);
+
+	// Merge each range on its own thread, into its own sstables
+	double bitsPerKey = this->filterBitsPerKey(outputLevel);
+	std::vector<std::map<uint64_t, std::shared_ptr<SStable> > > rangeSSTables(rangeNum);
+	std::vector<std::thread> subcompactions;
+	for(uint64_t i = 0; i < rangeNum; i++){
+		uint64_t lastKey = (i + 1 < rangeNum) ? firstKeys[i + 1] - 1 : UINT64_MAX;
+		auto run = [&, i, lastKey]{
+			this->subcompact(sstableSelect, level, outputLevel, firstKeys[i], lastKey, isBottomLevel, snapshots,
+				WriteTimeStamp, bitsPerKey, rangeSSTables[i]);
+		};
+		// The last range runs on the compaction thread itself
+		if(i + 1 < rangeNum)
+			subcompactions.push_back(std::thread(run));
+		else
+			run();
 	}
+	for(auto &thread : subcompactions)
+		thread.join();
 
-	// Convert the sortMapProcessed to entriyMap
-	std::map<uint64_t, std::map<uint64_t, uint32_t> > entriyMap;
-	uint64_t listSSTfileSize = sstable_headerSize + sstable_bfSize;
-
-	for(auto iter = sortMapProcessed.begin(); iter != sortMapProcessed.end(); iter++){
-		uint64_t curKey = iter->first;
-		uint64_t curOffset = iter->second.begin()->second.begin()->first;
-		uint32_t curVlen = iter->second.begin()->second.begin()->second;
+	std::map<uint64_t, std::shared_ptr<SStable> > newSSTables;
+	for(auto &sstables : rangeSSTables)
+		newSSTables.insert(sstables.begin(), sstables.end());
+	for(auto iter = newSSTables.begin(); iter != newSSTables.end(); iter++)
+		this->compactionBytesWritten.fetch_add(iter->second->getSStableFileSize(), std::memory_order_relaxed);
 
-		// Update the new sstable file size
-		uint64_t addSize = sstable_keySize + sstable_offsetSize + sstable_vlenSize;
+	/*
+		Step4: replace the selected sstables with the new ones
+	*/
+	lock.lock();
 
-		if(listSSTfileSize + addSize <= sstable_maxSize){
-			listSSTfileSize += addSize;
-			entriyMap[curKey][curOffset] = curVlen;
-		} else{
-			// Write the already stored entries into a new sstable
-			std::chrono::time_point<std::chrono::system_clock> now = std::chrono::system_clock::now();
-			std::chrono::microseconds nstime = std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch());
-			std::string newFilePath = this->SSTdir + "/level-" + std::to_string(level+1) + "/" + std::to_string(nstime.count()) + ".sst";
+	std::map<uint64_t, LevelEdit> edits;
+	for(auto iter = newSSTables.begin(); iter != newSSTables.end(); iter++)
+		this->levelIndex[outputLevel][iter->first] = iter->second;
+	edits[outputLevel].added = newSSTables;
 
-			SStable *newSSTable = new SStable(WriteTimeStamp, entriyMap, newFilePath, curvLogOffset);
-			this->levelIndex[level+1][nstime.count()] = newSSTable;
+	// Delete the selected old sstables in level X and the output level
+	// The files go now, the objects stay until no version holds them
+	for(auto iterX = sstableSelect.begin(); iterX != sstableSelect.end(); iterX++){
+		for(auto iterY = iterX->second.begin(); iterY != iterX->second.end(); iterY++){
+			iterY->second->clear();
 
-			// Reset the entriyMap and listSSTfileSize
-			entriyMap.clear();
-			listSSTfileSize = sstable_headerSize + sstable_bfSize;
-			entriyMap[curKey][curOffset] = curVlen;
+			levelIndex[iterX->first].erase(iterY->first);
 		}
+		edits[iterX->first].removed.insert(iterX->second.begin(), iterX->second.end());
 	}
+	this->installVersion(edits);
+}
 
-	// Write the remaining entries into a new sstable
-	if(entriyMap.size() > 0){
-		// Generate the filename
-		std::chrono::time_point<std::chrono::system_clock> now = std::chrono::system_clock::now();
-		std::chrono::microseconds nstime = std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch());
-		std::string newFilePath = this->SSTdir + "/level-" + std::to_string(level+1) + "/" + std::to_string(nstime.count()) + ".sst";
-
-		SStable *newSSTable = new SStable(WriteTimeStamp, entriyMap, newFilePath, curvLogOffset);
-		this->levelIndex[level+1][nstime.count()] = newSSTable;
-
-		// Reset the entriyMap and listSSTfileSize
-		entriyMap.clear();
-		listSSTfileSize = sstable_headerSize + sstable_bfSize;
-	}
-
-	// Delete the selected old sstables in level X and X+1
-	for(auto iterX = sstableSelect[level].begin(); iterX != sstableSelect[level].end(); iterX++){
-		for(auto iterY = sstableSelect[iterX->first].begin(); iterY != sstableSelect[iterX->first].end(); iterY++){
-			SStable *curtable = iterY->second;
-			curtable->clear();
-
-			if(curtable != NULL)
-				delete curtable;
-			if(levelIndex[iterX->first].count(iterY->first) == 1)
-				levelIndex[iterX->first].erase(iterY->first);
+/**
+ * Merge the keys in [firstKey, lastKey] of the selected sstables into
+ * new sstables of the output level.
+ * The entries are streamed through a heap of cursors, one per input
+ * sstable, in key order and newest first for each key.
+ */
+void KVStore::subcompact(const std::map<uint64_t, std::map<uint64_t, std::shared_ptr<SStable> > > &sstableSelect,
+	uint64_t level, uint64_t outputLevel, uint64_t firstKey, uint64_t lastKey, bool isBottomLevel, const std::vector<uint64_t> &snapshots,
+	uint64_t writeTimeStamp, double bitsPerKey, std::map<uint64_t, std::shared_ptr<SStable> > &newSSTables){
+	std::vector<MergeCursor> heap;
+
+	for(auto iterX = sstableSelect.begin(); iterX != sstableSelect.end(); iterX++){
+		for(auto iterY = iterX->second.begin(); iterY != iterX->second.end(); iterY++){
+			SStable *curtable = iterY->second.get();
+			uint64_t begin = curtable->getLowerBoundIndex(firstKey);
+			uint64_t end = (lastKey == UINT64_MAX) ? curtable->getSStableKeyValNum() : curtable->getLowerBoundIndex(lastKey + 1);
+			if(begin < end)
+				heap.push_back({curtable, begin, end, iterX->first == level, curtable->getSStableTimeStamp(), iterY->first});
 		}
 	}
+	std::make_heap(heap.begin(), heap.end(), mergeCursorAfter);
+
+	// Stream the entries into the new sstables
+	std::string levelPath = this->SSTdir + "/level-" + std::to_string(outputLevel);
+	SStableBuilder builder(levelPath, writeTimeStamp, this->options.filterFormat,
+		bitsPerKey, this->options.rangeFilterBitsPerPrefix, [this]{ return this->newFileID(); }, this->rateLimiter);
+	// Versions of the current key kept so far
+	std::vector<IndexEntry> versions;
+	size_t lastStripe = 0;
+
+	while(!heap.empty()){
+		std::pop_heap(heap.begin(), heap.end(), mergeCursorAfter);
+		MergeCursor &cursor = heap.back();
+		SStable *curtable = cursor.sstable;
+		IndexEntry entry = {curtable->getSStableKey(cursor.pos), curtable->getSStableKeyOffset(cursor.pos),
+			curtable->getSStableKeyVlen(cursor.pos), curtable->getSStableKeySeq(cursor.pos)};
+
+		if(++cursor.pos < cursor.end)
+			std::push_heap(heap.begin(), heap.end(), mergeCursorAfter);
+		else
+			heap.pop_back();
+
+		if(!versions.empty() && versions.front().key != entry.key)
+			addKeyVersions(builder, versions, isBottomLevel, this->vlog.get());
+
+		// Keep the latest value of each key and the older ones the snapshots see,
+		// a newer version is seen by the same snapshots
+		size_t stripe = snapshotStripe(snapshots, entry.seq);
+		if(!versions.empty() && stripe == lastStripe)
+			continue;
+		versions.push_back(entry);
+		lastStripe = stripe;
+	}
+	addKeyVersions(builder, versions, isBottomLevel, this->vlog.get());
+	newSSTables = builder.finish();
 }
 
 /**
  * This reclaims space from vLog by moving valid value and discarding invalid value.
  * chunk_size is the size in byte you should AT LEAST recycle.
+ * Nothing is reclaimed while a snapshot is live.
  */
 void KVStore::gc(uint64_t chunk_size)
 {
+	// The older values the snapshots read look like garbage here, keep them until the snapshots are released
+	if(!this->liveSnapshots().empty())
+		return;
+
 	/*
 	 *	Step1: scan all vLog entries in the chunk_size
 	 */
 	// Add the key-offset pair in the vlog to the keyOffsetMap
 	std::map<uint64_t, std::map<uint64_t, std::string> > keyOffsetMap; // key -> {offset, value}
 
+	// Hold the vlog and its cache, a reset may replace them meanwhile
+	std::shared_ptr<vLog> vlog;
+	std::shared_ptr<ValueCache> valueCache;
+	{
+		std::unique_lock<std::mutex> lock(this->mutex);
+		vlog = this->vlog;
+		valueCache = this->valueCache;
+	}
+
 	// Get the current vlog offset
-	uint64_t curOffset = this->vlog->getTail() + 15; // 8B Key + 4B vlen + 2B Checksum + 1B Magic
+	uint64_t curOffset = vlog->getTail() + 15; // 8B Key + 4B vlen + 2B Checksum + 1B Magic
 	uint64_t curSize = 0;
 
-	// Scan the vlog
+	// Scan the vlog, stop at a hole or a broken entry
 	while(curSize < chunk_size){
-		// Get the key and value offset
-		uint64_t key = this->vlog->getKeyFromFile(this->vLogdir, curOffset);
-		uint32_t vlen = this->vlog->getVlenFromFile(this->vLogdir, curOffset);
-		std::string value = this->vlog->getValFromFile(this->vLogdir, curOffset, vlen);
-		
-		// Check if the key is valid
-		if(key != 0 && vlen != 0){
-			keyOffsetMap[key][curOffset] = value;
-			curSize += vlen + 15;
-			curOffset += vlen + 15;
-		}
+		uint64_t key;
+		std::string value;
+		if(!vlog->readEntry(curOffset, key, value))
+			break;
+
+		// An empty value takes the header alone
+		keyOffsetMap[key][curOffset] = value;
+		curSize += value.size() + 15;
+		curOffset += value.size() + 15;
 	}
 
 	/*
 	 *	Step2: Check the latest log for each key
 	 */
+	int slot;
+	Version* version = this->versions.acquire(slot);
 	for(auto iter = keyOffsetMap.begin(); iter != keyOffsetMap.end(); iter++){
 		uint64_t key = iter->first;
-		// Get the latest value from sstable
-		std::string latestValue = this->get(key);
+		// Find the latest entry of the key, a value in a memtable is newer than the chunk
+		std::string value;
+		uint64_t offset;
+		uint32_t vlen;
+		if(this->locate(version, key, UINT64_MAX, value, offset, vlen))
+			continue;
 
-		// Check if the value is valid
-		if(latestValue == iter->second.begin()->second){
-			// Insert the value into the memtable
-			this->put(key, latestValue);
-		}
+		// Check if the latest entry is in the chunk, an empty value or a tombstone is moved as well
+		auto latest = iter->second.find(offset);
+		if(latest == iter->second.end())
+			continue;
+
+		// Pace the relocations behind the flushes
+		if(this->rateLimiter != nullptr)
+			this->rateLimiter->request(sizeof(key) + latest->second.size(), ratelimit_low);
+
+		// Insert the value into the memtable
+		this->putEntry(key, latest->second);
+	}
+	this->versions.release(version, slot);
+
+	// The values in the chunk are moved, their old offsets are not read again
+	for(auto iter = keyOffsetMap.begin(); iter != keyOffsetMap.end(); iter++){
+		for(auto iter2 = iter->second.begin(); iter2 != iter->second.end(); iter2++)
+			valueCache->erase(iter2->first);
 	}
 
 	/*
-	 *	Step3: Dig holes in the vlog
+	 *	Step3: Dig holes over the scanned entries, the tail moves to the first entry after them
 	 */
-	utils::de_alloc_file(this->vlog->getPath(), this->vlog->getTail(), chunk_size);
-	uint64_t newTail = utils::seek_data_block(this->vlog->getPath());
-	
-	// Find the the location of the new tail
-	for(auto iter = keyOffsetMap.begin(); iter != keyOffsetMap.end(); iter++){
-		for(auto iter2 = iter->second.begin(); iter2 != iter->second.end(); iter2++){
-			if(iter2->first-15 >= newTail){
-				newTail = iter2->first-15;
-
-				// Convert the {key, vlen, value} to data
-				std::vector<unsigned char> data;
-				const unsigned char* keyPtr = reinterpret_cast<const unsigned char*>(&iter->first);
-				const unsigned char* vlenPtr = reinterpret_cast<const unsigned char*>(iter2->second.size());	
-				data.insert(data.end(), keyPtr, keyPtr + sizeof(iter->first));
-				data.insert(data.end(), vlenPtr, vlenPtr + sizeof(iter2->second.size()));
-				data.insert(data.end(), iter2->second.begin(), iter2->second.end());			
-
-				// Get current checksum
-				uint16_t curChecksum = utils::crc16(data);
-
-				// Check if the tail is valid and update it
-				uint8_t magic = this->vlog->getMagicFromFile(this->vlog->getPath(), iter2->first);
-				uint16_t checksum = this->vlog->getChecksumFromFile(this->vlog->getPath(), iter2->first);
-
-				if(magic == 0xff && checksum == curChecksum){
-					this->vlog->setTail(newTail);
-					break;
-				}
-			}
-		}
+	uint64_t tail = vlog->getTail();
+	uint64_t newTail = curOffset - 15;
+	if(newTail > tail){
+		utils::de_alloc_file(vlog->getPath(), tail, newTail - tail);
+		vlog->setTail(newTail);
 	}
 }
-	
\ No newline at end of file
+	
+
+/**
+ * Return the counters of the store.
+ */
+Statistics KVStore::getStatistics()
+{
+	Statistics stats;
+	int slot;
+	Version* version = this->versions.acquire(slot);
+	stats.valueCacheHits = version->valueCache->getHits();
+	stats.valueCacheMisses = version->valueCache->getMisses();
+	this->versions.release(version, slot);
+	stats.scanSSTablesSkipped = this->scanSSTablesSkipped.load(std::memory_order_relaxed);
+	stats.scanSSTablesScanned = this->scanSSTablesScanned.load(std::memory_order_relaxed);
+	stats.bytesIngested = this->bytesIngested.load(std::memory_order_relaxed);
+	stats.flushBytesWritten = this->flushBytesWritten.load(std::memory_order_relaxed);
+	stats.compactionBytesWritten = this->compactionBytesWritten.load(std::memory_order_relaxed);
+	stats.rateLimiterWaitMicros = (this->rateLimiter == nullptr) ? 0 : this->rateLimiter->getTotalWaitMicros();
+	return stats;
+}
@@ -4,54 +4,176 @@
 #include "sstable.h"
 #include "memtable.h"
 #include "vLog.h"
+#include "version.h"
+#include "iterator.h"
+#include "snapshot.h"
+#include "writebatch.h"
+#include "valuecache.h"
+#include "ratelimiter.h"
+#include "statistics.h"
+#include "options.h"
 #include <cstdint>
 #include <sys/types.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <vector>
+#include <set>
 
 class KVStore : public KVStoreAPI
 {
 	// You can add your implementation here
 private:
+	// Reads the pinned version, the vLog and the scan statistics
+	friend class Iterator;
+
+	// Options given at open time
+	Options options;
 
 	// Directory for storing sstables
 	std::string SSTdir, vLogdir;
 	// Index of sstable in each level
-	std::map<uint64_t, std::map<uint64_t, SStable*> > levelIndex;
+	LevelIndex levelIndex;
 	
 	/****************************************************
-		levelIndex[level-i][timestamp] = sstable
+		levelIndex[level-i][fileID] = sstable
 	****************************************************/
 
 	// Memtable
-	MemTable* memtable;
-
-	// vLog
-	vLog* vlog;
-	uint64_t curvLogOffset;
+	std::shared_ptr<MemTable> memtable;
+	// Immutable memtable waiting for the background flush
+	std::shared_ptr<MemTable> immMemtable = nullptr;
+
+	// Versions pinned by the readers, a new one is installed on every change
+	VersionSet versions;
+	// Files of the levels in the current version, a level is rebuilt only when it changes
+	std::shared_ptr<const Levels> levels = std::make_shared<const Levels>();
+
+	// Background flush thread
+	std::thread flushThread;
+	// Protect memtable, immMemtable and levelIndex, readers use the versions instead
+	std::mutex mutex;
+	// Wake the flush thread when a memtable is frozen
+	std::condition_variable flushCond;
+	// Wake the writers when the immutable memtable is flushed
+	std::condition_variable immCond;
+	bool stopFlush = false;
+
+	// Background compaction threads
+	std::vector<std::thread> compactionThreads;
+	// Wake the compaction threads when a level may need merging
+	std::condition_variable compactionCond;
+	// Wake the stalled writers and the waiters when a merge finishes
+	std::condition_variable stallCond;
+	// Levels being merged, both level X and its output level are marked
+	std::set<uint64_t> busyLevels;
+	uint64_t runningCompactions = 0;
+	bool stopCompaction = false;
+
+	// Last id used for an sstable filename
+	std::atomic<uint64_t> lastFileID{0};
+
+	// vLog, shared with the versions so that a reset does not free it under a reader
+	std::shared_ptr<vLog> vlog;
+	// Values read from the vLog by get and scan, replaced along with the vLog
+	std::shared_ptr<ValueCache> valueCache;
+	// Paces the flushes, merges and gc relocations, nullptr for no limit
+	RateLimiter* rateLimiter = nullptr;
+	// Sstables skipped and read by scan
+	std::atomic<uint64_t> scanSSTablesSkipped{0};
+	std::atomic<uint64_t> scanSSTablesScanned{0};
+	// Bytes ingested and written to disk, for the write amplification
+	std::atomic<uint64_t> bytesIngested{0};
+	std::atomic<uint64_t> flushBytesWritten{0};
+	std::atomic<uint64_t> compactionBytesWritten{0};
 
 	// Maintain the current timestamp
 	uint64_t sstMaxTimeStamp = 0;
 
+	// Last sequence number given to a put or del, protected by mutex
+	uint64_t lastSequence = 0;
+	// Sequence numbers of the live snapshots, protected by mutex
+	std::multiset<uint64_t> snapshots;
+
 	// Check all the files in the directory 
 	void sstFileCheck(std::string path);
 
+	// Insert a key-value pair into the memtable, without counting it as ingested
+	void putEntry(uint64_t key, const std::string &s);
+
+	// Hand the full memtable over to the flush thread
+	void freezeMemTable(std::unique_lock<std::mutex> &lock);
+	// Persist the memtable to level-0 and the vLog
+	void flushMemTable(std::shared_ptr<MemTable> imm);
+	// Main loop of the flush thread
+	void backgroundFlush();
+
 	// Compact the sstable in level i
-	uint64_t mergeCheck();
-	void merge(uint64_t level);
+	int mergeCheck();
+	// Score of a level against its limitation, over 1 once it needs merging
+	double levelScore(uint64_t levelNum, const LevelFiles &level, const std::vector<double> &targets);
+	// Bytes the levels hold over their limitations
+	double compactionDebt();
+	// Raise the rate of the rate limiter with the compaction debt
+	void tuneRateLimiter();
+	// Target bytes of each level and the base level that level-0 merges into
+	std::vector<double> levelTargetBytes(const Levels &levels, uint64_t minLastLevel, uint64_t &baseLevel);
+	uint64_t mergeOutputLevel(uint64_t level, uint64_t baseLevel);
+	void merge(uint64_t level, uint64_t outputLevel);
+	// Merge one key range of the selected sstables, run by the subcompaction threads of a merge
+	void subcompact(const std::map<uint64_t, std::map<uint64_t, std::shared_ptr<SStable> > > &sstableSelect,
+		uint64_t level, uint64_t outputLevel, uint64_t firstKey, uint64_t lastKey, bool isBottomLevel, const std::vector<uint64_t> &snapshots,
+		uint64_t writeTimeStamp, double bitsPerKey, std::map<uint64_t, std::shared_ptr<SStable> > &newSSTables);
+	// Main loop of a compaction thread
+	void backgroundCompaction();
+	// Delay or stop the writer when level-0 is too large
+	void makeRoomForWrite(std::unique_lock<std::mutex> &lock);
+
+	// Get a unique id for a new sstable file
+	uint64_t newFileID();
+	// Filter bits per key of a new sstable in the level
+	double filterBitsPerKey(uint64_t level);
+
+	// Publish the current state to the readers, the levels not listed are shared with the last version
+	void installVersion(const std::map<uint64_t, LevelEdit> &edits = {});
+	// Get the value of a key in a pinned version, as seen at sequence
+	std::string get(Version* version, uint64_t key, uint64_t sequence);
+	// Find the newest entry of a key, the value if it is in a memtable, else its place in the vLog
+	bool locate(Version* version, uint64_t key, uint64_t sequence, std::string &value, uint64_t &offset, uint32_t &vlen);
+	// Sorted sequence numbers of the live snapshots
+	std::vector<uint64_t> liveSnapshots();
 
 public:
-	KVStore(const std::string &dir);
+	KVStore(const std::string &dir, const Options &options = Options());
 
 	~KVStore();
 
 	void put(uint64_t key, const std::string &s) override;
 
+	void write(const WriteBatch &batch);
+
 	std::string get(uint64_t key) override;
 
+	std::string get(uint64_t key, const Snapshot* snapshot);
+
+	std::vector<std::string> multiGet(const std::vector<uint64_t> &keys);
+
 	bool del(uint64_t key) override;
 
 	void reset() override;
 
 	void scan(uint64_t key1, uint64_t key2, std::list<std::pair<uint64_t, std::string>> &list) override;
 
+	void scan(uint64_t key1, uint64_t key2, std::list<std::pair<uint64_t, std::string>> &list, const Snapshot* snapshot);
+
+	Iterator* newIterator(uint64_t upperBound = UINT64_MAX, const Snapshot* snapshot = nullptr);
+
+	const Snapshot* getSnapshot();
+
+	void releaseSnapshot(const Snapshot* snapshot);
+
 	void gc(uint64_t chunk_size) override;
+
+	Statistics getStatistics();
 };
@@ -1,231 +1,245 @@
-#include "memtable.h"
-#include <cstddef>
-#include <cstdint>
-#include <string>
-
-const int log_putID = 0;
-const int log_delID = 1;
-const std::string log_putStr = "PUT";
-const std::string log_delStr = "DEL"; 
-
-// Constructor
-MemTable::MemTable() {
-    // Initialize the memtable
-    skiplist = new Skiplist<uint64_t, std::string>();
-    // Record the size
-    sstSpaceSize = sstable_headerSize + sstable_bfSize;
-
-    // Create log
-    this->restoreFromLog(logFilePath);
-}
-
-// Destructor
-MemTable::~MemTable() {
-    utils::rmdir(logFilePath);
-    delete skiplist;
-    skiplist = nullptr;
-}
-
-/****************************************************************************************
- **                                 Private functions                                  **
- ****************************************************************************************/
-
-// Insert key-value pair into memtable
-void MemTable::putKV(uint64_t key, const std::string &s) {
-    // Check if the key already exists
-    Node<uint64_t, std::string> *tryFind = skiplist->find(key);
-
-    // If the key exists, update the value
-    if (tryFind != nullptr) {
-        // Update the value
-        this->skiplist->insert(key, s);
-        // Modify the size of memtable
-        if(s.size() > tryFind->value.size()) {
-            sstSpaceSize += s.size() - tryFind->value.size();
-        } else {
-            sstSpaceSize -= tryFind->value.size() - s.size();
-        }
-    } else {
-        // If the key does not exist, insert the key-value pair
-        this->skiplist->insert(key, s);
-        // Enlarge the size of memtable
-        sstSpaceSize += sstable_keySize + sstable_offsetSize + s.size();
-    }
-}
-
-// Delete key-value pair by key
-bool MemTable::delKV(uint64_t key) {
-    // Check if the key exists
-    auto tryFind = this->skiplist->find(key);
-
-    // If the key don't exist, return false
-    if (tryFind == nullptr)
-        return false;
-    
-    // If the key exists, modify the value to be deleted
-    tryFind->value = delete_tag;
-    // Update the size
-    if(sizeof(delete_tag) > tryFind->value.size())
-        sstSpaceSize += sizeof(delete_tag) - tryFind->value.size();
-    else 
-        sstSpaceSize -= tryFind->value.size() - sizeof(delete_tag);
-    return true;
-}
-
-/****************************************************************************************
- **                                 Public functions                                   **
- ****************************************************************************************/
-
-// Interface: PUT(Key, Value)
-void MemTable::put(uint64_t key, const std::string &s) {
-    // Insert the key-value pair into memtable
-    this->putKV(key, s);
-    // Write log
-    this->writeLog(logFilePath, log_putID, key, s);
-}
-
-// Interface: DEL(Key)
-bool MemTable::del(uint64_t key) {
-    // Write log
-    this->writeLog(logFilePath, log_delID, key, "");
-    // Return whether successfilly delete the key-value pair
-    return (this->delKV(key));
-}
-
-// Interface: GET(Key)
-std::string MemTable::get(uint64_t key) {
-    // Find the key-value pair by key
-    auto tryFind = this->skiplist->find(key);
-
-    // If the key exists, return the value
-    if (tryFind != nullptr) {
-        std::string res = tryFind->value;
-        // Check if the value is already deleted
-        if(res == delete_tag)
-            return memtable_already_deleted;
-        return res;
-    } 
-
-    // If the key does not exist, return empty string
-    return memtable_not_exist;
-}
-
-// Interface: RESET()
-void MemTable::reset() {
-    // Clear all logs before
-    utils::rmdir(logFilePath);
-    // Clear all key-value pairs in memtable
-    this->skiplist->clear();
-    // Reset the size of memtable
-    sstSpaceSize = sstable_headerSize + sstable_bfSize;
-}
-
-// Interface: SCAN(Key1, Key2)
-void MemTable::scan(uint64_t key1, uint64_t key2, std::list<std::pair<uint64_t, std::string>> &list) {
-    // Start scanning from key1
-    Node<uint64_t, std::string> *iter = this->skiplist->find(key1);
-    
-    // Traverse the skiplist
-    while (iter->type == nodeType_Data && iter->key <= key2) {
-        // Check if the value is already deleted
-        if(iter->value != delete_tag)
-            list.push_back(std::make_pair(iter->key, iter->value));
-        iter = iter->next[0];
-    }
-    return;
-}
-
-// Check if the memtable is full before inserting key-value pair
-bool MemTable::putCheck(uint64_t key, const std::string &s) {
-    // New size after inserting the key-value pair
-    size_t newSize = sstable_keySize + sstable_offsetSize + s.size();
-
-    Node<uint64_t, std::string> *tryFind = skiplist->find(key);
-
-    // If the key don't exist, add the newSize and check whether out of limitation
-    if (tryFind == nullptr) {
-        return (sstSpaceSize + newSize <= sstable_maxSize);
-    } else {
-        // If the key exists, check whether the new size is larger than the old size
-        if (newSize > tryFind->value.size()) {
-            return (sstSpaceSize + newSize - tryFind->value.size() <= sstable_maxSize);
-        } else {
-            return true;
-        }
-    }
-}
-
-// Copy the key-value pairs in memtable to sstable
-std::list<std::pair<uint64_t, std::string>> MemTable::copyAll() {
-    std::list<std::pair<uint64_t, std::string>> list;
-    this->skiplist->copyAll(list);
-    return list;
-}
-
-// Write log
-void MemTable::writeLog(std::string path, int operationID, uint64_t key, std::string value) {
-    // Open the log file
-    std::ofstream outFile(path, std::fstream::out | std::fstream::app);
-
-    switch (operationID) {
-        case log_putID:
-            outFile << log_putStr << " " << key << " " << value << std::endl;
-            break;
-        case log_delID:
-            outFile << log_delStr << " " << key << std::endl;
-            break;
-        default:
-            break;
-    }
-
-    // Close the log file
-    outFile.close();
-}
-
-// Restore from log
-void MemTable::restoreFromLog(std::string path) {
-    // Open the log file
-    std::ifstream inFile;
-    inFile.open(path);
-
-    std::string rowLog;
-    std::string operationType;
-    uint64_t key;
-    std::string value;
-
-    if(inFile.is_open()) {
-        while(getline(inFile, rowLog)) {
-            std::vector<size_t> spaceIndex;
-
-            // scan for the first two spaces
-            for(size_t i = 0; i < rowLog.size(); i++){
-                if(rowLog[i] == ' '){
-                    spaceIndex.push_back(i);
-                }
-
-                if(spaceIndex.size() == 2)
-                    break;
-                if(spaceIndex.size() == 1 && rowLog.substr(0, spaceIndex[0]) == log_delStr)
-                    break;
-            }
-
-            if(spaceIndex.size() == 1){
-                operationType = rowLog.substr(0, spaceIndex[0]);
-                std::stringstream keyStringStream(rowLog.substr(spaceIndex[0] + 1, spaceIndex[1] - spaceIndex[0] - 1));
-                keyStringStream >> key;
-
-                this->delKV(key);
-            }
-            else if(spaceIndex.size() == 2){
-                operationType = rowLog.substr(0, spaceIndex[0]);
-
-                std::stringstream keyStringStream(rowLog.substr(spaceIndex[0] + 1, spaceIndex[1] - spaceIndex[0] - 1));
-                keyStringStream >> key;
-
-                value = rowLog.substr(spaceIndex[1] + 1);
-
-                this->putKV(key, value);
-            }
-        }
-    }
+#include "memtable.h"
+#include "snapshot.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <algorithm>
+#include <numeric>
+
+const int log_putID = 0;
+const int log_delID = 1;
+
+// Constructor
+MemTable::MemTable(std::string logPath, int walSyncMode, uint64_t walSyncIntervalMs, uint64_t lastSequence) {
+    // Initialize the memtable
+    skiplist = new ConcurrentSkiplist<uint64_t, std::string>();
+    // Record the size
+    sstSpaceSize = sstable_headerSize + sstable_bfSize;
+    activeWriters = 0;
+    this->lastSequence = lastSequence;
+
+    // Restore from the log and keep appending to it
+    uint64_t validSize = this->restoreFromLog(logPath);
+    this->wal = std::make_shared<WAL>(logPath, validSize, walSyncMode, walSyncIntervalMs);
+}
+
+// Destructor
+MemTable::~MemTable() {
+    delete skiplist;
+    skiplist = nullptr;
+}
+
+/****************************************************************************************
+ **                                 Private functions                                  **
+ ****************************************************************************************/
+
+// Insert key-value pair into memtable
+void MemTable::putKV(uint64_t key, const std::string &s, uint64_t version) {
+    // Enlarge the size of memtable
+    sstSpaceSize += this->putSpace(key, s);
+    // Insert the key-value pair, or update the value if the key exists
+    this->skiplist->insert(key, s, version);
+}
+
+// Delete key-value pair by key
+bool MemTable::delKV(uint64_t key, uint64_t version) {
+    // If the key don't exist, return false
+    if (this->skiplist->find(key) == nullptr)
+        return false;
+
+    // If the key exists, modify the value to be deleted
+    this->putKV(key, delete_tag, version);
+    return true;
+}
+
+// Bytes a put adds to the sstable
+size_t MemTable::putSpace(uint64_t key, const std::string &s) {
+    ConcurrentNode<uint64_t, std::string> *tryFind = skiplist->find(key);
+
+    // A new key takes a whole entry
+    if (tryFind == nullptr)
+        return sstable_keySize + sstable_offsetSize + s.size();
+
+    // Shrinking is not counted, concurrent puts of a key may land in any order
+    size_t oldSize = tryFind->valueSize();
+    return (s.size() > oldSize) ? s.size() - oldSize : 0;
+}
+
+/****************************************************************************************
+ **                                 Public functions                                   **
+ ****************************************************************************************/
+
+// Interface: PUT(Key, Value)
+uint64_t MemTable::put(uint64_t key, const std::string &s, uint64_t sequence) {
+    // Write log
+    uint64_t lsn = this->writeLog(log_putID, key, s, sequence);
+    // Insert the key-value pair into memtable, the sequence number orders the puts of the same key
+    this->skiplist->insert(key, s, sequence);
+    return lsn;
+}
+
+// Interface: WRITE(Batch)
+uint64_t MemTable::write(const WriteBatch &batch, uint64_t sequence) {
+    const std::vector<std::pair<uint64_t, std::string> > &operations = batch.getOperations();
+
+    // Write the whole batch as one log record, recovery replays all of it or nothing
+    std::string payload;
+    WAL::beginPayload(payload, sequence);
+    for (const auto &operation : operations)
+        WAL::addOperation(payload, log_putID, operation.first, operation.second);
+    uint64_t lsn = this->wal->append(payload);
+
+    // Insert in key order so that each search starts from the previous key
+    std::vector<size_t> order(operations.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(),
+        [&operations](size_t a, size_t b) { return operations[a].first < operations[b].first; });
+
+    ConcurrentFinger<uint64_t, std::string> finger;
+    for (size_t i : order)
+        this->skiplist->insert(operations[i].first, operations[i].second, sequence + i, &finger);
+    return lsn;
+}
+
+// Interface: DEL(Key)
+bool MemTable::del(uint64_t key, uint64_t sequence) {
+    // Write log
+    this->writeLog(log_delID, key, "", sequence);
+    // Return whether successfilly delete the key-value pair
+    return (this->delKV(key, sequence));
+}
+
+// Interface: GET(Key)
+std::string MemTable::get(uint64_t key, uint64_t sequence) {
+    // Find the key-value pair by key
+    auto tryFind = this->skiplist->find(key);
+    // Find the version seen at sequence
+    const ValueRecord* record = (tryFind != nullptr) ? tryFind->getRecord(sequence) : nullptr;
+
+    // If the key exists, return the value
+    if (record != nullptr) {
+        std::string res(record->data(), record->size);
+        // Check if the value is already deleted
+        if(res == delete_tag)
+            return memtable_already_deleted;
+        return res;
+    } 
+
+    // If the key does not exist, return empty string
+    return memtable_not_exist;
+}
+
+// Interface: RESET()
+void MemTable::reset() {
+    // Let the running puts finish before the arena is released
+    this->waitForWriters();
+    // Clear all logs before
+    this->wal->reset();
+    // Clear all key-value pairs in memtable
+    this->skiplist->clear();
+    // Reset the size of memtable
+    sstSpaceSize = sstable_headerSize + sstable_bfSize;
+}
+
+// Drop the log, the skiplist is freed with the memtable
+void MemTable::dropLog() {
+    this->waitForWriters();
+    this->wal->reset();
+}
+
+// Check if the memtable is full before inserting key-value pair
+bool MemTable::putCheck(uint64_t key, const std::string &s) {
+    // Add the new size and check whether out of limitation
+    return (sstSpaceSize + this->putSpace(key, s) <= sstable_maxSize);
+}
+
+// Reserve the space of a put before inserting it without the store lock
+bool MemTable::reserve(uint64_t key, const std::string &s) {
+    size_t newSize = this->putSpace(key, s);
+    if (sstSpaceSize + newSize > sstable_maxSize)
+        return false;
+    sstSpaceSize += newSize;
+    return true;
+}
+
+// Reserve the space of a batch, a key put twice is counted twice
+bool MemTable::reserve(const WriteBatch &batch, bool force) {
+    size_t newSize = 0;
+    for (const auto &operation : batch.getOperations())
+        newSize += this->putSpace(operation.first, operation.second);
+    if (!force && sstSpaceSize + newSize > sstable_maxSize)
+        return false;
+    sstSpaceSize += newSize;
+    return true;
+}
+
+// Unpin the memtable after a put
+void MemTable::endWrite() {
+    if (this->activeWriters.fetch_sub(1) == 1) {
+        std::lock_guard<std::mutex> lock(this->writerMutex);
+        this->writerCond.notify_all();
+    }
+}
+
+// Wait for the pinned puts
+void MemTable::waitForWriters() {
+    std::unique_lock<std::mutex> lock(this->writerMutex);
+    this->writerCond.wait(lock, [this]{ return this->activeWriters.load() == 0; });
+}
+
+// Copy the key-value pairs in memtable to sstable
+std::list<std::pair<uint64_t, std::string>> MemTable::copyAll(const std::vector<uint64_t> &snapshots, std::vector<uint64_t> &sequences) {
+    std::list<std::pair<uint64_t, std::string>> list;
+    sequences.clear();
+
+    for (auto node = this->skiplist->lowerBound(0); node != nullptr; node = node->getNext(0)) {
+        // Keep the newest version of each snapshot stripe
+        size_t lastStripe = 0;
+        bool isFirst = true;
+        for (const ValueRecord* record = node->getRecord(UINT64_MAX); record != nullptr; record = record->older) {
+            size_t stripe = snapshotStripe(snapshots, record->version);
+            if (!isFirst && stripe == lastStripe)
+                continue;
+            list.push_back(std::make_pair(node->key, std::string(record->data(), record->size)));
+            sequences.push_back(record->version);
+            lastStripe = stripe;
+            isFirst = false;
+        }
+    }
+    return list;
+}
+
+// Move the log to another path
+void MemTable::moveLog(std::string newPath) {
+    // Rename the log file so that a fresh memtable can take the old path
+    this->wal->moveTo(newPath);
+}
+
+// Write log
+uint64_t MemTable::writeLog(int operationID, uint64_t key, const std::string &value, uint64_t sequence) {
+    // Encode the operation as one record
+    std::string payload;
+    WAL::beginPayload(payload, sequence);
+    WAL::addOperation(payload, operationID, key, value);
+
+    // Append the record, the caller syncs it outside the store lock
+    return this->wal->append(payload);
+}
+
+// Restore from log
+uint64_t MemTable::restoreFromLog(std::string path) {
+    // Scan the log once, the sequence numbers order the operations whatever their order in the log
+    return WAL::replay(path, [this](uint8_t operationID, uint64_t key, const std::string &value, uint64_t sequence) {
+        switch (operationID) {
+            case log_putID:
+                this->putKV(key, value, sequence);
+                break;
+            case log_delID:
+                this->delKV(key, sequence);
+                break;
+            default:
+                return;
+        }
+        this->lastSequence = std::max(this->lastSequence, sequence);
+    });
 }
\ No newline at end of file
@@ -1,51 +1,100 @@
-#pragma once
-#include "skiplist.h"
-#include "utils.h"
-#include "config.h"
-#include <fstream>
-#include <list>
-
-class MemTable {
-private:
-    // Use skiplist as container
-    Skiplist<uint64_t, std::string>* skiplist;
-    // Size of memtable when transferred to sstable
-    size_t sstSpaceSize;
-
-    // Internal functions
-    void putKV(uint64_t key, const std::string &s);
-    bool delKV(uint64_t key);
-
-    // Introduce log for debug
-    void writeLog(std::string path, int operationID, uint64_t key, std::string value);
-    void restoreFromLog(std::string path);
-
-public:
-    MemTable();
-    ~MemTable();
-
-    // Check if memtable is full
-    bool putCheck(uint64_t key, const std::string &s);
-
-    // Put key-value pair into memtable
-    void put(uint64_t key, const std::string &s);
-
-    // Get value by key
-    std::string get(uint64_t key);
-
-    // Delete key-value pair by key
-    bool del(uint64_t key);
-
-    // Clear all key-value pairs in memtable
-    void reset();
-
-    // Scan key-value pairs in memtable
-    void scan(uint64_t key1, uint64_t key2, std::list<std::pair<uint64_t, std::string>> &list);
-
-    // Copy all key-value pairs in memtable to sstable
-    std::list<std::pair<uint64_t, std::string>> copyAll();
-
-    // Print all key-value pairs in memtable
-    void tranverse(){this->skiplist->tranverse();};
-    
+#pragma once
+#include "concurrent_skiplist.h"
+#include "utils.h"
+#include "config.h"
+#include "wal.h"
+#include "writebatch.h"
+#include <fstream>
+#include <list>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+class MemTable {
+private:
+    // Use skiplist as container, writers insert into it concurrently
+    ConcurrentSkiplist<uint64_t, std::string>* skiplist;
+    // Size of memtable when transferred to sstable, only changed under the store lock
+    size_t sstSpaceSize;
+    // Writers inserting without the store lock
+    std::atomic<int> activeWriters;
+    std::mutex writerMutex;
+    std::condition_variable writerCond;
+    // Log backing this memtable
+    std::shared_ptr<WAL> wal;
+    // Last sequence number given before the log or replayed from it
+    uint64_t lastSequence;
+
+    // Internal functions
+    void putKV(uint64_t key, const std::string &s, uint64_t version);
+    bool delKV(uint64_t key, uint64_t version);
+    // Bytes a put adds to the sstable
+    size_t putSpace(uint64_t key, const std::string &s);
+
+    // Introduce log for recovery
+    uint64_t writeLog(int operationID, uint64_t key, const std::string &value, uint64_t sequence);
+    uint64_t restoreFromLog(std::string path);
+
+public:
+    // The operations replayed from the log keep the sequence numbers they were given
+    MemTable(std::string logPath = logFilePath, int walSyncMode = wal_sync_mode, uint64_t walSyncIntervalMs = wal_sync_interval_ms,
+        uint64_t lastSequence = 0);
+    ~MemTable();
+
+    // Check if memtable is full
+    bool putCheck(uint64_t key, const std::string &s);
+
+    // Reserve the space of a put, return false if memtable is full
+    bool reserve(uint64_t key, const std::string &s);
+    // Reserve the space of a whole batch, with force it is taken even past the limit
+    bool reserve(const WriteBatch &batch, bool force = false);
+
+    // Put key-value pair into memtable as version sequence, return the position to sync the log to
+    // Several threads can put at once, the space must be reserved before
+    uint64_t put(uint64_t key, const std::string &s, uint64_t sequence);
+    // Put a batch as one log record, the operations take the versions from sequence on
+    uint64_t write(const WriteBatch &batch, uint64_t sequence);
+
+    // Pin the memtable for a put done without the store lock
+    void beginWrite(){this->activeWriters.fetch_add(1);};
+    void endWrite();
+    // Wait for the pinned puts before flushing or clearing
+    void waitForWriters();
+
+    // Get value by key, as seen by the snapshot at sequence
+    std::string get(uint64_t key, uint64_t sequence = UINT64_MAX);
+
+    // Delete key-value pair by key
+    bool del(uint64_t key, uint64_t sequence);
+
+    // Clear all key-value pairs in memtable
+    void reset();
+
+    // Drop the log once the memtable is persisted, the key-value pairs stay for the readers
+    void dropLog();
+
+    // Get the first node whose key >= key, nullptr if none, the nodes are walked by an iterator
+    ConcurrentNode<uint64_t, std::string>* lowerBound(uint64_t key){return this->skiplist->lowerBound(key);};
+
+    // Copy all key-value pairs in memtable to sstable, newest first for each key,
+    // with the older versions still seen by the snapshots and the sequence number of each one
+    std::list<std::pair<uint64_t, std::string>> copyAll(const std::vector<uint64_t> &snapshots, std::vector<uint64_t> &sequences);
+
+    // Last sequence number replayed from the log
+    uint64_t getLastSequence(){return this->lastSequence;};
+
+    // Check if memtable holds no key-value pair
+    bool empty(){return this->skiplist->getSize() == 0;};
+
+    // Move the log to another path when the memtable is frozen
+    void moveLog(std::string newPath);
+
+    // Get the log to wait for the durability of a put
+    std::shared_ptr<WAL> getWAL(){return this->wal;};
+
+    // Print all key-value pairs in memtable
+    void tranverse(){this->skiplist->tranverse();};
+    
 };
\ No newline at end of file
@@ -0,0 +1,75 @@
+#pragma once
+#include "config.h"
+#include <cstdint>
+
+// Options of a KVStore, given at open time
+struct Options {
+    // Compaction: number of background threads running merge
+    uint64_t compactionThreadNum = compaction_thread_num;
+
+    // Compaction: compaction_leveled or compaction_tiered
+    int compactionStyle = compaction_style;
+
+    // Compaction: sorted runs a tiered level holds before they are merged into the next level
+    uint64_t tieredSizeRatio = compaction_tiered_size_ratio;
+
+    // Compaction: most key ranges a merge is split into, each merged by its own thread
+    uint64_t maxSubcompactions = compaction_max_subcompactions;
+
+    // Compaction: level-0 file num that starts a merge
+    uint64_t level0CompactionTrigger = level0_compaction_trigger;
+
+    // Compaction: number of levels, level-0 included
+    uint64_t levelNum = level_num;
+
+    // Compaction: size ratio of two adjacent levels
+    uint64_t levelFanout = level_fanout;
+
+    // Compaction: least target bytes of the base level, the deeper levels are sized from the last one
+    uint64_t levelBaseBytes = level_base_bytes;
+
+    // RateLimit: bytes per second of the flushes, merges and gc relocations, 0 to disable
+    uint64_t rateLimitBytesPerSecond = ratelimit_bytes_per_second;
+
+    // RateLimit: raise the rate up to ratelimit_max_boost times while the levels are over their targets
+    bool rateLimitAutoTune = ratelimit_auto_tune;
+
+    // Compaction: level-0 file num at which each write is delayed
+    uint64_t level0SlowdownTrigger = level0_slowdown_trigger;
+
+    // Compaction: level-0 file num at which writes stop until merged
+    uint64_t level0StopTrigger = level0_stop_trigger;
+
+    // Compaction: delay of a slowed down write in microseconds
+    uint64_t slowdownDelayMicros = level0_slowdown_delay;
+
+    // SSTable: filter format of the new sstables, sstable_filter_blocked or sstable_filter_xor
+    int filterFormat = sstable_filter_format;
+
+    // SSTable: average filter bits per key of the new sstables
+    double filterBitsPerKey = sstable_filter_bits_per_key;
+
+    // SSTable: split filterBitsPerKey across the levels to minimize the false positives of a lookup
+    bool filterPerLevel = sstable_filter_per_level;
+
+    // SSTable: range filter bits per distinct key prefix of the new sstables, 0 to disable
+    double rangeFilterBitsPerPrefix = sstable_range_filter_bits_per_prefix;
+
+    // Log: wal_sync_write, wal_sync_group or wal_sync_interval
+    int walSyncMode = wal_sync_mode;
+
+    // Log: interval of wal_sync_interval in milliseconds
+    uint64_t walSyncIntervalMs = wal_sync_interval_ms;
+
+    // vLog: vlog_read_pread or vlog_read_mmap
+    int vLogReadMode = vlog_read_mode;
+
+    // vLog: largest gap between two values fetched by one multiGet read
+    uint64_t vLogCoalesceGap = vlog_coalesce_gap;
+
+    // vLog: bytes preallocated past the end of the vLog, 0 to disable
+    uint64_t vLogPreallocSize = vlog_prealloc_size;
+
+    // Cache: bytes of vLog values cached, 0 to disable
+    uint64_t valueCacheSize = value_cache_size;
+};
@@ -2,9 +2,12 @@
 #include <cstdint>
 #include <string>
 #include <cassert>
+#include <filesystem>
+#include <fstream>
 #include <semaphore.h>
 #include <random>
 #include <signal.h>
+#include <sys/wait.h>
 
 #include "test.h"
 
@@ -13,6 +16,9 @@ class PersistenceTest : public Test
 private:
 	const uint64_t TEST_MAX = 1024 * 32;
 	const uint64_t GC_TRIGGER = 1024;
+	// Keys written together by one WriteBatch in the loop
+	const uint64_t BATCH_KEY_BASE = TEST_MAX * 2;
+	const uint64_t BATCH_KEYS = 16;
 
 public:
 	void prepare()
@@ -88,6 +94,7 @@ public:
 	{
 		std::cout << "Data is ready, start looping and wait to be terminated!" << std::endl;
 		std::cout.flush();
+		uint64_t round = 0;
 		while (true)
 		{
 			volatile int dummy;
@@ -108,15 +115,28 @@ public:
 					dummy = i;
 
 				store.put(TEST_MAX + i, std::string(512, 'x'));
+
+				// A batch is recovered whole or not at all
+				WriteBatch batch;
+				for (uint64_t key = 0; key < BATCH_KEYS; ++key)
+					batch.put(BATCH_KEY_BASE + key, std::string(256, 'b') + std::to_string(round));
+				store.write(batch);
+				++round;
 			}
 		}
 	}
 
-	void test()
+	void test(uint64_t validLogSize)
 	{
 		std::cout << "KVStore Persistence Test" << std::endl;
 		std::cout << "<<Test Mode>>" << std::endl;
 		uint64_t i;
+
+		// The torn tail is dropped, the next records follow the valid ones
+		EXPECT(validLogSize, (uint64_t)std::filesystem::file_size(logFilePath));
+
+		phase();
+
 		// Test data
 		for (i = 0; i < TEST_MAX; ++i)
 		{
@@ -145,6 +165,14 @@ public:
 
 		phase();
 
+		// All the keys of the batches hold the value of the same batch
+		std::string batchValue = store.get(BATCH_KEY_BASE);
+		EXPECT(true, batchValue != not_found);
+		for (i = 1; i < BATCH_KEYS; ++i)
+			EXPECT(batchValue, store.get(BATCH_KEY_BASE + i));
+
+		phase();
+
 		report();
 	}
 
@@ -198,13 +226,23 @@ int main(int argc, char *argv[])
 		int wait_time = dis(gen);
 		usleep(1000 * wait_time);
 		kill(pid, SIGINT);
+		waitpid(pid, NULL, 0);
 		printf("Killing loop after %d ms.\n", wait_time);
 		std::cout << std::endl;
 
+		// Tear the tail of the log as a crash in the middle of an append does,
+		// the header promises more bytes than follow it
+		uint64_t validLogSize = std::filesystem::file_size(logFilePath);
+		std::ofstream log(logFilePath, std::ios::binary | std::ios::app);
+		uint32_t length = 1024;
+		log.write(reinterpret_cast<const char*>(&length), sizeof(length));
+		log.write("torn", 4);
+		log.close();
+
 		PersistenceTest test("./data", "./data/vlog", verbose);
 
 		// test for data integrity
-		test.test();
+		test.test(validLogSize);
 	}
 	else
 	{
@@ -0,0 +1,193 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include "keyhash.h"
+#include "config.h"
+
+/****************************************************************
+    Prefix Bloom filter answering whether a key range may hold keys
+    Every key adds its prefixes key >> shift for the shifts
+    step, 2 * step, ..., levels * step to one Bloom filter
+    A range is checked at the finest shift where it spans at most
+    sstable_range_filter_max_probes prefixes, a wider range is let
+    through
+
+    File: Magic(4Byte) + Format(1Byte) + Levels(1Byte) + Step(1Byte)
+          + Probes(1Byte) + Bits(8Byte) + Bits / 8 Byte
+****************************************************************/
+
+class RangeFilter {
+private:
+    static const size_t headerSize = 16;
+
+    // A prefix is hashed together with its shift
+    struct Prefix {
+        uint64_t prefix;
+        uint64_t shift;
+    };
+
+    uint8_t levels = sstable_range_filter_levels;
+    uint8_t step = sstable_range_filter_step;
+    uint8_t probes = 0;
+    std::vector<uint64_t> bits;
+
+    void setBit(uint64_t bit) {bits[bit >> 6] |= 1ULL << (bit & 63);};
+    bool getBit(uint64_t bit) const {return bits[bit >> 6] & (1ULL << (bit & 63));};
+    // Check if a prefix of the shift is in the filter
+    bool findPrefix(uint64_t prefix, uint64_t shift) const;
+
+public:
+    // Build the filter of the sorted keys
+    RangeFilter(const std::vector<uint64_t> &keys, double bitsPerPrefix);
+    RangeFilter(std::string path, uint64_t offset);
+    ~RangeFilter(){};
+
+    // Check if [key1, key2] may hold a key
+    bool mayContain(uint64_t key1, uint64_t key2) const;
+
+    // Load the filter from a file, 0 if there is one
+    int readFile(std::string path, uint64_t offset);
+    // Save the filter to a file
+    uint64_t writeToFile(std::string path, uint64_t offset);
+
+    // Bytes of the filter in memory
+    uint64_t getMemoryUsage() const {return bits.size() * sizeof(uint64_t);};
+    bool empty() const {return bits.empty();};
+};
+
+// Build the filter of the sorted keys
+inline RangeFilter::RangeFilter(const std::vector<uint64_t> &keys, double bitsPerPrefix) {
+    // Sorted keys share their prefixes with their neighbours, count each one once
+    std::vector<Prefix> prefixes;
+    for (uint64_t level = 1; level <= levels; level++) {
+        uint64_t shift = level * step;
+        for (size_t i = 0; i < keys.size(); i++) {
+            uint64_t prefix = keys[i] >> shift;
+            if (i == 0 || prefix != (keys[i - 1] >> shift))
+                prefixes.push_back({prefix, shift});
+        }
+    }
+
+    uint64_t bitNum = std::max<uint64_t>(64, prefixes.size() * bitsPerPrefix);
+    bits.assign((bitNum + 63) / 64, 0);
+    probes = std::min<long>(8, std::max<long>(1, std::lround(bitsPerPrefix * 0.69314718)));
+
+    bitNum = bits.size() * 64;
+    for (const Prefix &prefix : prefixes) {
+        KeyHash keyHash(prefix);
+        for (uint32_t i = 0; i < probes; i++)
+            setBit(keyHash.probe(i) % bitNum);
+    }
+}
+
+// Parameterized constructor
+inline RangeFilter::RangeFilter(std::string path, uint64_t offset) {
+    readFile(path, offset);
+}
+
+// Check if a prefix of the shift is in the filter
+inline bool RangeFilter::findPrefix(uint64_t prefix, uint64_t shift) const {
+    Prefix target = {prefix, shift};
+    KeyHash keyHash(target);
+    uint64_t bitNum = bits.size() * 64;
+    for (uint32_t i = 0; i < probes; i++) {
+        if (!getBit(keyHash.probe(i) % bitNum))
+            return false;
+    }
+    return true;
+}
+
+// Check if [key1, key2] may hold a key
+inline bool RangeFilter::mayContain(uint64_t key1, uint64_t key2) const {
+    if (bits.empty())
+        return true;
+
+    // The finest shift where the range spans few prefixes
+    for (uint64_t level = 1; level <= levels; level++) {
+        uint64_t shift = level * step;
+        uint64_t first = key1 >> shift;
+        uint64_t last = key2 >> shift;
+        if (last - first >= sstable_range_filter_max_probes)
+            continue;
+
+        for (uint64_t prefix = first; prefix <= last; prefix++) {
+            if (findPrefix(prefix, shift))
+                return true;
+        }
+        return false;
+    }
+    return true;
+}
+
+// Load the filter from a file, 0 if there is one
+inline int RangeFilter::readFile(std::string path, uint64_t offset) {
+    std::ifstream inFile(path, std::ios::in | std::ios::binary);
+    // Return -1 if the file cannot be opened
+    if (!inFile)
+        return -1;
+
+    inFile.seekg(0, std::ios::end);
+    uint64_t fileLimit = inFile.tellg();
+
+    // Return -2 if there is no filter, the tables written before it end at the index
+    if (offset + headerSize > fileLimit) {
+        inFile.close();
+        return -2;
+    }
+
+    uint32_t magic = 0;
+    uint8_t format = 0;
+    uint64_t bitNum = 0;
+    inFile.seekg(offset, std::ios::beg);
+    inFile.read((char*)&magic, sizeof(magic));
+    inFile.read((char*)&format, sizeof(format));
+    inFile.read((char*)&levels, sizeof(levels));
+    inFile.read((char*)&step, sizeof(step));
+    inFile.read((char*)&probes, sizeof(probes));
+    inFile.read((char*)&bitNum, sizeof(bitNum));
+
+    // Return -3 if the filter is not there or out of bounds
+    if (magic != sstable_filter_magic || format != sstable_filter_range
+        || offset + headerSize + bitNum / 8 > fileLimit) {
+        inFile.close();
+        return -3;
+    }
+
+    bits.resize(bitNum / 64);
+    inFile.read((char*)bits.data(), bits.size() * sizeof(uint64_t));
+    inFile.close();
+    return 0;
+}
+
+// Save the filter to a file
+inline uint64_t RangeFilter::writeToFile(std::string path, uint64_t offset) {
+    std::fstream outFile(path, std::ios::out | std::ios::in | std::ios::binary);
+
+    // Return -1 if the file cannot be opened
+    if (!outFile)
+        return -1;
+
+    // Magic(4Byte) + Format(1Byte) + Levels(1Byte) + Step(1Byte) + Probes(1Byte) + Bits(8Byte)
+    char header[headerSize] = {0};
+    uint32_t magic = sstable_filter_magic;
+    uint8_t format = sstable_filter_range;
+    uint64_t bitNum = bits.size() * 64;
+    memcpy(header, &magic, sizeof(magic));
+    memcpy(header + 4, &format, sizeof(format));
+    memcpy(header + 5, &levels, sizeof(levels));
+    memcpy(header + 6, &step, sizeof(step));
+    memcpy(header + 7, &probes, sizeof(probes));
+    memcpy(header + 8, &bitNum, sizeof(bitNum));
+
+    outFile.seekp(offset, std::ios::beg);
+    outFile.write(header, headerSize);
+    outFile.write((char*)bits.data(), bits.size() * sizeof(uint64_t));
+    outFile.close();
+
+    return offset;
+}
@@ -0,0 +1,95 @@
+#include "ratelimiter.h"
+#include <algorithm>
+
+// Constructor
+RateLimiter::RateLimiter(uint64_t bytesPerSecond, uint64_t refillPeriodMicros) {
+    this->bytesPerSecond = bytesPerSecond;
+    this->refillPeriodMicros = std::max<uint64_t>(refillPeriodMicros, 1);
+    this->available = this->burstBytes();
+    this->lastRefill = std::chrono::steady_clock::now();
+    this->totalBytes = 0;
+    this->totalWaitMicros = 0;
+}
+
+/****************************************************************************************
+ **                                 Private functions                                  **
+ ****************************************************************************************/
+
+// Most tokens the bucket holds, one refill period's worth
+int64_t RateLimiter::burstBytes() {
+    return std::max<int64_t>(this->bytesPerSecond * this->refillPeriodMicros / 1000000, 1);
+}
+
+// Add the tokens earned since the last refill
+void RateLimiter::refill() {
+    auto now = std::chrono::steady_clock::now();
+    uint64_t elapsed = std::chrono::duration_cast<std::chrono::microseconds>(now - this->lastRefill).count();
+    int64_t earned = elapsed * this->bytesPerSecond / 1000000;
+
+    // Keep the time of a fraction of a byte for the next refill
+    if (earned == 0)
+        return;
+    this->available = std::min(this->available + earned, this->burstBytes());
+    this->lastRefill = now;
+}
+
+/****************************************************************************************
+ **                                 Public functions                                   **
+ ****************************************************************************************/
+
+// Wait until bytes may be written
+void RateLimiter::request(uint64_t bytes, int priority) {
+    auto start = std::chrono::steady_clock::now();
+    {
+        std::unique_lock<std::mutex> lock(this->mutex);
+        this->waiting[priority]++;
+
+        while (this->bytesPerSecond > 0) {
+            this->refill();
+
+            // Flushes go first, the writers wait on them
+            bool yield = priority == ratelimit_low && this->waiting[ratelimit_high] > 0;
+            if (!yield && this->available > 0) {
+                this->available -= bytes;
+                break;
+            }
+
+            // Sleep until the bucket is positive again, or check back after a period while yielding
+            uint64_t micros = yield ? this->refillPeriodMicros
+                : (1 - this->available) * 1000000 / this->bytesPerSecond + 1;
+            this->cond.wait_for(lock, std::chrono::microseconds(std::min(micros, this->refillPeriodMicros)));
+        }
+        this->waiting[priority]--;
+    }
+    // The yielding requests may go on
+    this->cond.notify_all();
+
+    this->totalBytes.fetch_add(bytes, std::memory_order_relaxed);
+    this->totalWaitMicros.fetch_add(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count(), std::memory_order_relaxed);
+}
+
+// Bytes worth requesting at once
+uint64_t RateLimiter::getSingleBurstBytes() {
+    std::unique_lock<std::mutex> lock(this->mutex);
+    return (this->bytesPerSecond == 0) ? UINT64_MAX : this->burstBytes();
+}
+
+// Change the rate
+void RateLimiter::setBytesPerSecond(uint64_t bytesPerSecond) {
+    {
+        std::unique_lock<std::mutex> lock(this->mutex);
+        if (this->bytesPerSecond == bytesPerSecond)
+            return;
+        // Settle the tokens earned at the old rate
+        this->refill();
+        this->bytesPerSecond = bytesPerSecond;
+        this->available = std::min(this->available, this->burstBytes());
+    }
+    this->cond.notify_all();
+}
+
+uint64_t RateLimiter::getBytesPerSecond() {
+    std::unique_lock<std::mutex> lock(this->mutex);
+    return this->bytesPerSecond;
+}
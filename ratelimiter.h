@@ -0,0 +1,57 @@
+#pragma once
+#include "config.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+/****************************************************************
+    RateLimiter: token bucket pacing the background writes
+    Tokens are bytes, refilled at bytesPerSecond and capped at one
+    refill period's worth, a request larger than the tokens left
+    goes through and the next ones wait until it is paid back
+    A low priority request yields while a high priority one waits
+****************************************************************/
+
+class RateLimiter {
+private:
+    std::mutex mutex;
+    // Wake the waiters when the rate changes or a request finishes
+    std::condition_variable cond;
+
+    uint64_t bytesPerSecond;
+    uint64_t refillPeriodMicros;
+
+    // Tokens left, negative while a large request is paid back
+    int64_t available;
+    std::chrono::steady_clock::time_point lastRefill;
+
+    // Requests waiting for tokens by priority
+    uint64_t waiting[ratelimit_priority_num] = {0};
+
+    std::atomic<uint64_t> totalBytes;
+    std::atomic<uint64_t> totalWaitMicros;
+
+    // Most tokens the bucket holds
+    int64_t burstBytes();
+    // Add the tokens earned since the last refill
+    void refill();
+
+public:
+    RateLimiter(uint64_t bytesPerSecond, uint64_t refillPeriodMicros = ratelimit_refill_period_us);
+
+    // Wait until bytes may be written, priority is ratelimit_high or ratelimit_low
+    void request(uint64_t bytes, int priority);
+
+    // Bytes worth requesting at once, a larger write is split into pieces of this size
+    uint64_t getSingleBurstBytes();
+
+    // Change the rate, 0 lets every request through
+    void setBytesPerSecond(uint64_t bytesPerSecond);
+    uint64_t getBytesPerSecond();
+
+    // Counters of the requests
+    uint64_t getTotalBytes(){return totalBytes.load(std::memory_order_relaxed);};
+    uint64_t getTotalWaitMicros(){return totalWaitMicros.load(std::memory_order_relaxed);};
+};
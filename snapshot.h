@@ -0,0 +1,29 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+/****************************************************************
+    Snapshot: a point-in-time view of the store
+    Every put and del takes the next sequence number, a snapshot
+    sees the versions up to its own sequence number
+    Flush and compaction keep the newest version of a key seen by
+    each live snapshot, the versions in between are dropped
+****************************************************************/
+
+class Snapshot {
+private:
+    uint64_t sequence;
+
+public:
+    explicit Snapshot(uint64_t sequence) : sequence(sequence) {};
+
+    // Last sequence number seen by the snapshot
+    uint64_t getSequence() const {return this->sequence;};
+};
+
+// Index of the oldest snapshot that sees a version, snapshots.size() if only the latest reads do
+// The versions of a key in one stripe are seen by the same snapshots, only the newest is kept
+inline size_t snapshotStripe(const std::vector<uint64_t> &snapshots, uint64_t sequence) {
+    return std::lower_bound(snapshots.begin(), snapshots.end(), sequence) - snapshots.begin();
+}
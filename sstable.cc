@@ -1,232 +1,356 @@
-#include "sstable.h"
-#include "config.h"
-#include "utils.h"
-#include <cstdint>
-#include <sys/types.h>
-
-// Default Constructor
-SStable::SStable(){};
-
-// Constructor from file
-SStable::SStable(std::string path){
-    this->path = path;
-    // Init the pointers
-    this->header = new SSTheader(path, 0);
-    this->bloomFliter = new BloomFilter<uint64_t, sstable_bfSize>(path, sstable_headerSize);
-    this->index = new SSTIndex(path, sstable_headerSize + sstable_bfSize, header->keyValNum);
-
-    // Read the file
-    std::ifstream inFile(path, std::ios::binary | std::ios::in);
-
-    // Get the size
-    if(inFile){
-        inFile.seekg(0, std::ios::end);
-        this->fileSize = inFile.tellg();
-        inFile.close();
-    }
-}
-
-// Constructor from list
-SStable::SStable(
-    uint64_t setTimeStamp,
-    std::list <std::pair<uint64_t, std::string> > &list,
-    std::string setPath, uint64_t curvLogOffset){
-    
-    this->path = setPath;
-    this->header = new SSTheader();
-    this->bloomFliter = new BloomFilter<uint64_t, sstable_bfSize>();
-    this->index = new SSTIndex();
-
-    // Init the offset in vlog
-    uint64_t vLogOffset = curvLogOffset;
-
-    // Set the header and bloom filter
-    this->header->timeStamp = setTimeStamp;
-    uint64_t MinKey = UINT64_MAX;
-    uint64_t MaxKey = 0;
-
-    for(auto iter = list.begin(); iter != list.end(); iter++){
-        // Update the MinKey and MaxKey
-        MinKey = std::min(MinKey, iter->first);
-        MaxKey = std::max(MaxKey, iter->first);
-
-        // Insert the key and value
-        this->bloomFliter->insert(iter->first);
-        this->index->insert(iter->first, vLogOffset, iter->second.size());
-
-        // Update the vLogOffset: Magic(1Byte) + Checksum(2Byte) + Key(8Byte) + vlen(4Byte) + Value
-        vLogOffset += 15 + iter->second.size();
-    }
-
-    this->header->minKey = MinKey;
-    this->header->maxKey = MaxKey;
-    this->header->keyValNum = list.size();
-
-    // Write the sstable to the file
-    this->header->writeToFile(setPath, 0);
-    this->bloomFliter->writeToFile(setPath, sstable_headerSize);
-    this->index->writeToFile(setPath, sstable_headerSize + sstable_bfSize);
-
-    // Read the file again
-    std::ifstream inFile(setPath, std::ios::binary | std::ios::in);
-
-    // Refresh the size
-    if(inFile){
-        inFile.seekg(0, std::ios::end);
-        this->fileSize = inFile.tellg();
-        inFile.close();
-    }
-}
-
-// Constructor from entries
-SStable::SStable(
-    uint64_t setTimeStamp,
-    std::map<uint64_t, std::map<uint64_t, uint32_t> > &entriyMap,
-    std::string setPath, uint64_t curvLogOffset){
-    
-    this->path = setPath;
-    this->header = new SSTheader();
-    this->bloomFliter = new BloomFilter<uint64_t, sstable_bfSize>();
-    this->index = new SSTIndex();
-
-    // Init the offset in vlog
-    uint64_t vLogOffset = curvLogOffset;
-
-    // Set the header and bloom filter
-    this->header->timeStamp = setTimeStamp;
-    uint64_t MinKey = UINT64_MAX;
-    uint64_t MaxKey = 0;
-
-    for(auto iter = entriyMap.begin(); iter != entriyMap.end(); iter++){
-        // Update the MinKey and MaxKey
-        MinKey = std::min(MinKey, iter->first);
-        MaxKey = std::max(MaxKey, iter->first);
-
-        // Insert the key and value
-        this->bloomFliter->insert(iter->first);
-        this->index->insert(iter->first, entriyMap[iter->first].begin()->first, entriyMap[iter->first].begin()->second);
-
-        // Update the vLogOffset: Magic(1Byte) + Checksum(2Byte) + Key(8Byte) + vlen(4Byte) + Value
-        vLogOffset += 15 + iter->second.begin()->second;
-    }
-
-    this->header->minKey = MinKey;
-    this->header->maxKey = MaxKey;
-    this->header->keyValNum = entriyMap.size();
-
-    // Write the sstable to the file
-    this->header->writeToFile(setPath, 0);
-    this->bloomFliter->writeToFile(setPath, sstable_headerSize);
-    this->index->writeToFile(setPath, sstable_headerSize + sstable_bfSize);
-
-    // Read the file again
-    std::ifstream inFile(setPath, std::ios::binary | std::ios::in);
-
-    if(inFile){
-        inFile.seekg(0, std::ios::end);
-        this->fileSize = inFile.tellg();
-        inFile.close();
-    }
-}    
-
-// Destructor
-SStable::~SStable(){
-    delete this->header;
-    delete this->bloomFliter;
-    delete this->index;
-}
-
-// Clear all the data
-void SStable::clear(){
-    utils::rmfile(this->path.c_str());
-}
-
-// Get the target from the sstable
-uint64_t SStable::getSStableTimeStamp(){
-    return this->header->timeStamp;
-}
-
-uint64_t SStable::getSStableMinKey(){
-    return this->header->minKey;
-}
-
-uint64_t SStable::getSStableMaxKey(){
-    return this->header->maxKey;
-}
-    
-uint64_t SStable::getSStableKeyValNum(){
-    return this->header->keyValNum;
-}
-
-uint32_t SStable::getSStableKeyVlen(uint64_t index){
-    return this->index->getVlen(index);
-}
-    
-uint64_t SStable::getSStableKeyOffset(uint64_t index){
-    return this->index->getOffset(index);
-}
-
-uint64_t SStable::getSStableKey(uint64_t index){
-    return this->index->getKey(index);
-}
-
-uint64_t SStable::getKeyIndexByKey(uint64_t key){
-    return this->index->getIndex(key);
-}
-
-// Check if the key exists
-bool SStable::checkIfKeyExist(uint64_t targetKey){
-    // Check if the key is within the range
-    if(targetKey < this->header->minKey || targetKey > this->header->maxKey)
-        return false;
-
-    // Check if the key exists in the bloom filter
-    return this->bloomFliter->find(targetKey);
-}
-
-// Scan the sstable
-void SStable::scan(uint64_t key1, uint64_t key2, std::map<uint64_t, std::map<uint64_t, std::string> > &scanMap, vLog vlog){
-    uint32_t startKeyIndex = this->getKeyIndexByKey(key1);
-
-    // Check if the key exists
-    if(startKeyIndex == UINT32_MAX)
-        return;
-
-    // Get the current timestamp
-    uint64_t curSStabelTimeStamp = this->getSStableTimeStamp();
-    for (size_t i = startKeyIndex; i < this->getSStableKeyValNum(); i++)
-    {
-        uint64_t curKey = this->index->getKey(i);
-        if(curKey > key2)
-            break;
-    
-        // If the key does not exist in the scanMap, insert it
-        if(scanMap.count(curKey) == 0 || scanMap[curKey].size() == 0){
-            uint64_t targetOffset = this->getSStableKeyOffset(i);
-            uint32_t targetLength = this->getSStableKeyVlen(i);
-            std::string val = vlog.getValFromFile(vlog.getPath(), targetOffset, targetLength);
-            if(val != delete_tag)
-                scanMap[curKey][curSStabelTimeStamp] = val;
-        }
-        else{
-            // If the key exists in the scanMap, check the timestamp
-            auto iterLatestKV = scanMap[curKey].end();
-            iterLatestKV--;
-            // Cover the old value if the timestamp is larger
-            uint64_t targetOffset = this->getSStableKeyOffset(i);
-            uint32_t targetLength = this->getSStableKeyVlen(i);
-            std::string val = vlog.getValFromFile(vlog.getPath(), targetOffset, targetLength);
-            if(curSStabelTimeStamp >= iterLatestKV->first){
-                if(val != delete_tag){
-                    // Delete the old value to save space
-                    scanMap[curKey].clear();
-                    scanMap[curKey][curSStabelTimeStamp] = val;
-                }
-                // Clear all the old values if the new value is deleted
-                else
-                    scanMap[curKey].clear();
-            }
-            // Do nothing if the timestamp is smaller
-        }
-    }
-}
\ No newline at end of file
+#include "sstable.h"
+#include "config.h"
+#include "utils.h"
+#include <cstdint>
+#include <sys/types.h>
+
+// Default Constructor
+SStable::SStable(){};
+
+// Constructor from file
+SStable::SStable(std::string path){
+    this->path = path;
+    // Init the pointers
+    this->header = new SSTheader(path, 0);
+    this->loadFilter(path);
+    this->index = new SSTIndex(path, sstable_headerSize + this->filterSize, header->keyValNum);
+    this->index->readSeqs(path);
+
+    // Tables written without a range filter end at the index
+    this->rangeFilter = new RangeFilter(path, this->getRangeFilterOffset());
+    if(this->rangeFilter->empty()){
+        delete this->rangeFilter;
+        this->rangeFilter = NULL;
+    }
+
+    // Read the file
+    std::ifstream inFile(path, std::ios::binary | std::ios::in);
+
+    // Get the size
+    if(inFile){
+        inFile.seekg(0, std::ios::end);
+        this->fileSize = inFile.tellg();
+        inFile.close();
+    }
+}
+
+// Constructor from list
+SStable::SStable(
+    uint64_t setTimeStamp,
+    std::list <std::pair<uint64_t, std::string> > &list, const std::vector<uint64_t> &sequences,
+    std::string setPath, uint64_t curvLogOffset, int filterFormat, double bitsPerKey,
+    double rangeBitsPerPrefix){
+    
+    this->path = setPath;
+    this->header = new SSTheader();
+    this->newFilter(filterFormat, list.size(), bitsPerKey);
+    this->index = new SSTIndex();
+
+    // Init the offset in vlog
+    uint64_t vLogOffset = curvLogOffset;
+
+    // Set the header and bloom filter
+    this->header->timeStamp = setTimeStamp;
+    uint64_t MinKey = UINT64_MAX;
+    uint64_t MaxKey = 0;
+    std::vector<uint64_t> keys;
+
+    size_t i = 0;
+    for(auto iter = list.begin(); iter != list.end(); iter++, i++){
+        // Update the MinKey and MaxKey
+        MinKey = std::min(MinKey, iter->first);
+        MaxKey = std::max(MaxKey, iter->first);
+
+        // Insert the key and value, the filters take each key once
+        if(keys.empty() || keys.back() != iter->first){
+            this->insertFilter(iter->first);
+            keys.push_back(iter->first);
+        }
+        // The index points at the value, right after Magic(1Byte) + Checksum(2Byte) + Key(8Byte) + vlen(4Byte)
+        this->index->insert(iter->first, vLogOffset + 15, iter->second.size(), sequences[i]);
+
+        // Update the vLogOffset: Magic(1Byte) + Checksum(2Byte) + Key(8Byte) + vlen(4Byte) + Value
+        vLogOffset += 15 + iter->second.size();
+    }
+
+    this->header->minKey = MinKey;
+    this->header->maxKey = MaxKey;
+    this->header->keyValNum = list.size();
+
+    // Write the sstable to the file
+    this->header->writeToFile(setPath, 0);
+    this->writeFilter(setPath);
+    this->index->writeToFile(setPath, sstable_headerSize + this->filterSize);
+    this->writeRangeFilter(setPath, keys, rangeBitsPerPrefix);
+    this->index->writeSeqs(setPath);
+
+    // Read the file again
+    std::ifstream inFile(setPath, std::ios::binary | std::ios::in);
+
+    // Refresh the size
+    if(inFile){
+        inFile.seekg(0, std::ios::end);
+        this->fileSize = inFile.tellg();
+        inFile.close();
+    }
+}
+
+// Constructor from entries
+SStable::SStable(
+    uint64_t setTimeStamp,
+    const std::vector<IndexEntry> &entries,
+    std::string setPath, int filterFormat, double bitsPerKey,
+    double rangeBitsPerPrefix){
+    
+    this->path = setPath;
+    this->header = new SSTheader();
+    this->newFilter(filterFormat, entries.size(), bitsPerKey);
+    this->index = new SSTIndex();
+
+    // Set the header and bloom filter
+    this->header->timeStamp = setTimeStamp;
+    uint64_t MinKey = UINT64_MAX;
+    uint64_t MaxKey = 0;
+    std::vector<uint64_t> keys;
+
+    for(auto iter = entries.begin(); iter != entries.end(); iter++){
+        // Update the MinKey and MaxKey
+        MinKey = std::min(MinKey, iter->key);
+        MaxKey = std::max(MaxKey, iter->key);
+
+        // Insert the key and value, the filters take each key once
+        if(keys.empty() || keys.back() != iter->key){
+            this->insertFilter(iter->key);
+            keys.push_back(iter->key);
+        }
+        this->index->insert(iter->key, iter->offset, iter->vlen, iter->seq);
+    }
+
+    this->header->minKey = MinKey;
+    this->header->maxKey = MaxKey;
+    this->header->keyValNum = entries.size();
+
+    // Write the sstable to the file
+    this->header->writeToFile(setPath, 0);
+    this->writeFilter(setPath);
+    this->index->writeToFile(setPath, sstable_headerSize + this->filterSize);
+    this->writeRangeFilter(setPath, keys, rangeBitsPerPrefix);
+    this->index->writeSeqs(setPath);
+
+    // Read the file again
+    std::ifstream inFile(setPath, std::ios::binary | std::ios::in);
+
+    if(inFile){
+        inFile.seekg(0, std::ios::end);
+        this->fileSize = inFile.tellg();
+        inFile.close();
+    }
+}    
+
+// Create an empty filter of the format for keyNum keys
+void SStable::newFilter(int filterFormat, uint64_t keyNum, double bitsPerKey){
+    // The legacy filter has a fixed size, the xor filter about 9.84 bits per key
+    if(filterFormat == sstable_filter_blocked)
+        this->blockedFilter = new BlockedBloomFilter<uint64_t>(keyNum, bitsPerKey);
+    else if(filterFormat == sstable_filter_xor)
+        this->xorFilter = new XorFilter<uint64_t>(keyNum);
+    else
+        this->bloomFliter = new BloomFilter<uint64_t, sstable_bfSize>();
+}
+
+// Load the filter of the format found in the file
+void SStable::loadFilter(std::string path){
+    // Magic(4Byte) + Format(1Byte), the legacy filter has no header
+    uint32_t magic = 0;
+    uint8_t format = sstable_filter_legacy;
+    std::ifstream inFile(path, std::ios::binary | std::ios::in);
+    if(inFile){
+        inFile.seekg(sstable_headerSize, std::ios::beg);
+        inFile.read((char*)&magic, sizeof(magic));
+        inFile.read((char*)&format, sizeof(format));
+        inFile.close();
+    }
+
+    if(magic == sstable_filter_magic && format == sstable_filter_blocked){
+        this->blockedFilter = new BlockedBloomFilter<uint64_t>(path, sstable_headerSize);
+        this->filterSize = this->blockedFilter->getFileSize();
+    }
+    else if(magic == sstable_filter_magic && format == sstable_filter_xor){
+        this->xorFilter = new XorFilter<uint64_t>(path, sstable_headerSize);
+        this->filterSize = this->xorFilter->getFileSize();
+    }
+    else{
+        this->bloomFliter = new BloomFilter<uint64_t, sstable_bfSize>(path, sstable_headerSize);
+        this->filterSize = sstable_bfSize;
+    }
+}
+
+// Insert a key into the filter
+void SStable::insertFilter(uint64_t key){
+    if(this->blockedFilter != NULL)
+        this->blockedFilter->insert(key);
+    else if(this->xorFilter != NULL)
+        this->xorFilter->insert(key);
+    else
+        this->bloomFliter->insert(key);
+}
+
+// Write the filter after the header
+void SStable::writeFilter(std::string path){
+    if(this->blockedFilter != NULL){
+        this->blockedFilter->writeToFile(path, sstable_headerSize);
+        this->filterSize = this->blockedFilter->getFileSize();
+    }
+    else if(this->xorFilter != NULL){
+        // All the keys are in, build the table before writing it
+        this->xorFilter->build();
+        this->xorFilter->writeToFile(path, sstable_headerSize);
+        this->filterSize = this->xorFilter->getFileSize();
+    }
+    else{
+        this->bloomFliter->writeToFile(path, sstable_headerSize);
+        this->filterSize = sstable_bfSize;
+    }
+}
+
+// Offset of the range filter, right after the index
+uint64_t SStable::getRangeFilterOffset(){
+    // Key(8Byte) + Offset(8Byte) + Vlen(8Byte) for each key
+    return sstable_headerSize + this->filterSize + this->header->keyValNum * 3 * sizeof(uint64_t);
+}
+
+// Write the range filter of the sorted keys after the index
+void SStable::writeRangeFilter(std::string path, const std::vector<uint64_t> &keys, double bitsPerPrefix){
+    if(bitsPerPrefix <= 0)
+        return;
+    this->rangeFilter = new RangeFilter(keys, bitsPerPrefix);
+    this->rangeFilter->writeToFile(path, this->getRangeFilterOffset());
+}
+
+// Destructor
+SStable::~SStable(){
+    delete this->header;
+    delete this->bloomFliter;
+    delete this->blockedFilter;
+    delete this->xorFilter;
+    delete this->index;
+    delete this->rangeFilter;
+}
+
+// Clear all the data
+void SStable::clear(){
+    utils::rmfile(this->path.c_str());
+}
+
+// Get the target from the sstable
+uint64_t SStable::getSStableTimeStamp(){
+    return this->header->timeStamp;
+}
+
+uint64_t SStable::getSStableMinKey(){
+    return this->header->minKey;
+}
+
+uint64_t SStable::getSStableMaxKey(){
+    return this->header->maxKey;
+}
+    
+uint64_t SStable::getSStableKeyValNum(){
+    return this->header->keyValNum;
+}
+
+uint32_t SStable::getSStableKeyVlen(uint64_t index){
+    return this->index->getVlen(index);
+}
+    
+uint64_t SStable::getSStableKeyOffset(uint64_t index){
+    return this->index->getOffset(index);
+}
+
+uint64_t SStable::getSStableKey(uint64_t index){
+    return this->index->getKey(index);
+}
+
+uint64_t SStable::getSStableKeySeq(uint64_t index){
+    return this->index->getSeq(index);
+}
+
+uint64_t SStable::getSStableMaxSeq(){
+    return this->index->getMaxSeq();
+}
+
+uint64_t SStable::getSStableFileSize(){
+    return this->fileSize;
+}
+
+uint64_t SStable::getSStableSize(){
+    return sstable_headerSize + sstable_bfSize
+        + this->getSStableKeyValNum() * (sstable_keySize + sstable_offsetSize + sstable_vlenSize);
+}
+
+uint64_t SStable::estimateFileSize(uint64_t keyNum, int filterFormat, double bitsPerKey, double rangeBitsPerPrefix){
+    // The legacy filter has a fixed size, the xor filter about 9.84 bits per key
+    double filterBits = (filterFormat == sstable_filter_blocked) ? keyNum * bitsPerKey
+        : (filterFormat == sstable_filter_xor) ? keyNum * 9.84 : sstable_bfSize * 8.0;
+    double rangeFilterBits = (rangeBitsPerPrefix > 0) ? keyNum * rangeBitsPerPrefix : 0;
+
+    // Header + Filter + Index(24Byte per key) + Range filter + Seqs(8Byte per key) + Footer(8Byte)
+    return sstable_headerSize + (uint64_t)((filterBits + rangeFilterBits) / 8)
+        + keyNum * (3 * sizeof(uint64_t) + sizeof(uint64_t)) + 8;
+}
+
+uint64_t SStable::getKeyIndexByKey(uint64_t key){
+    return this->index->getIndex(key);
+}
+
+// Skip the versions of the key newer than the snapshot
+uint64_t SStable::getKeyIndexByKey(uint64_t key, uint64_t sequence){
+    uint64_t index = this->index->getIndex(key);
+    if(index == UINT64_MAX)
+        return UINT64_MAX;
+
+    uint64_t keyValNum = this->getSStableKeyValNum();
+    while(index < keyValNum && this->index->getKey(index) == key){
+        if(this->index->getSeq(index) <= sequence)
+            return index;
+        index++;
+    }
+    return UINT64_MAX;
+}
+
+uint64_t SStable::getLowerBoundIndex(uint64_t key){
+    return this->index->lowerBound(key);
+}
+
+// Check if the key exists
+bool SStable::checkIfKeyExist(uint64_t targetKey){
+    return this->checkIfKeyExist(targetKey, KeyHash(targetKey));
+}
+
+// Check if the key exists, the hash is shared by all the sstables of a lookup
+bool SStable::checkIfKeyExist(uint64_t targetKey, const KeyHash &keyHash){
+    // Check if the key is within the range
+    if(targetKey < this->header->minKey || targetKey > this->header->maxKey)
+        return false;
+
+    // Check if the key exists in the bloom filter
+    if(this->blockedFilter != NULL)
+        return this->blockedFilter->find(keyHash);
+    if(this->xorFilter != NULL)
+        return this->xorFilter->find(keyHash);
+    return this->bloomFliter->find(keyHash);
+}
+
+// Check if [key1, key2] may hold a key of the sstable
+bool SStable::checkIfRangeExist(uint64_t key1, uint64_t key2){
+    // Check the fences first, the range must overlap [minKey, maxKey]
+    if(key2 < this->header->minKey || key1 > this->header->maxKey)
+        return false;
+
+    // Only the part inside the fences can hold a key
+    key1 = std::max(key1, this->header->minKey);
+    key2 = std::min(key2, this->header->maxKey);
+    if(this->rangeFilter != NULL)
+        return this->rangeFilter->mayContain(key1, key2);
+    return true;
+}
@@ -1,61 +1,97 @@
-#pragma once
-
-#include "sstheader.h"
-#include "bloomfilter.h"
-#include "sstindex.h"
-#include "vLog.h"
-#include "config.h"
-#include <string>
-#include <cstdint>
-#include <list>
-#include <map>
-
-class SStable{
-private:
-    // Data part
-    std::string path;           // Path of the sstable file
-    uint64_t fileSize;          // Size of the sstable file
-
-    // Consruction part
-    SSTheader * header = NULL;
-    BloomFilter<uint64_t, sstable_bfSize > * bloomFliter = NULL;
-    SSTIndex * index = NULL;
-
-public:
-    
-    // Init a SStable from a file
-    SStable(std::string path);
-
-    // Init a SStable from a list
-    SStable(uint64_t setTimeStamp, 
-        std::list <std::pair<uint64_t, std::string> > &list,
-        std::string setPath, uint64_t curvLogOffset);
-
-    // Init a SStable from entries
-    SStable(uint64_t setTimeStamp, 
-        std::map<uint64_t, std::map<uint64_t, uint32_t> > &entriyMap,
-        std::string setPath, uint64_t curvLogOffset);
-    // entryMap:{key, offset, vlen}
-
-    // Clear all the data
-    void clear();
-
-    // Get the target from the sstable
-    uint64_t getSStableTimeStamp();
-    uint64_t getSStableMinKey();
-    uint64_t getSStableMaxKey();
-    uint64_t getSStableKeyValNum();
-
-    uint32_t getSStableKeyVlen(uint64_t index);
-    uint64_t getSStableKeyOffset(uint64_t index);
-    uint64_t getSStableKey(uint64_t index);
-    uint64_t getKeyIndexByKey(uint64_t key);
-    // std::string getSStableValue(size_t index);
-
-    bool checkIfKeyExist(uint64_t targetKey);
-
-    void scan(uint64_t key1, uint64_t key2, std::map<uint64_t, std::map<uint64_t, std::string> > &scanMap, vLog vlog);
-
-    SStable();
-    ~SStable();
+#pragma once
+
+#include "sstheader.h"
+#include "bloomfilter.h"
+#include "blockedbloomfilter.h"
+#include "xorfilter.h"
+#include "rangefilter.h"
+#include "sstindex.h"
+#include "vLog.h"
+#include "valuecache.h"
+#include "config.h"
+#include <string>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <vector>
+
+class SStable{
+private:
+    // Data part
+    std::string path;           // Path of the sstable file
+    uint64_t fileSize;          // Size of the sstable file
+    uint64_t filterSize;        // Size of the filter, the index follows it
+
+    // Consruction part
+    SSTheader * header = NULL;
+    BloomFilter<uint64_t, sstable_bfSize > * bloomFliter = NULL;
+    BlockedBloomFilter<uint64_t> * blockedFilter = NULL;
+    XorFilter<uint64_t> * xorFilter = NULL;
+    SSTIndex * index = NULL;
+    RangeFilter * rangeFilter = NULL;
+
+    // Create an empty filter of the format for keyNum keys
+    void newFilter(int filterFormat, uint64_t keyNum, double bitsPerKey);
+    // Load the filter of the format found in the file
+    void loadFilter(std::string path);
+    // Filter part of the construction
+    void insertFilter(uint64_t key);
+    void writeFilter(std::string path);
+    // Range filter part, it follows the index
+    uint64_t getRangeFilterOffset();
+    void writeRangeFilter(std::string path, const std::vector<uint64_t> &keys, double bitsPerPrefix);
+
+public:
+    
+    // Init a SStable from a file
+    SStable(std::string path);
+
+    // Init a SStable from a list, sequences holds the sequence number of each pair
+    SStable(uint64_t setTimeStamp, 
+        std::list <std::pair<uint64_t, std::string> > &list, const std::vector<uint64_t> &sequences,
+        std::string setPath, uint64_t curvLogOffset, int filterFormat = sstable_filter_format,
+        double bitsPerKey = sstable_filter_bits_per_key,
+        double rangeBitsPerPrefix = sstable_range_filter_bits_per_prefix);
+
+    // Init a SStable from entries sorted by key, newest first for each key, they keep their vlog offsets
+    SStable(uint64_t setTimeStamp, 
+        const std::vector<IndexEntry> &entries,
+        std::string setPath, int filterFormat = sstable_filter_format,
+        double bitsPerKey = sstable_filter_bits_per_key,
+        double rangeBitsPerPrefix = sstable_range_filter_bits_per_prefix);
+
+    // Clear all the data
+    void clear();
+
+    // Get the target from the sstable
+    uint64_t getSStableTimeStamp();
+    uint64_t getSStableMinKey();
+    uint64_t getSStableMaxKey();
+    uint64_t getSStableKeyValNum();
+    uint64_t getSStableMaxSeq();
+    uint64_t getSStableFileSize();
+    // Size in the units of sstable_maxSize, the size the sstables are split at
+    uint64_t getSStableSize();
+    // Bytes a new sstable of keyNum keys takes on disk, to charge the rate limiter before it is written
+    static uint64_t estimateFileSize(uint64_t keyNum, int filterFormat, double bitsPerKey, double rangeBitsPerPrefix);
+
+    uint32_t getSStableKeyVlen(uint64_t index);
+    uint64_t getSStableKeyOffset(uint64_t index);
+    uint64_t getSStableKey(uint64_t index);
+    uint64_t getSStableKeySeq(uint64_t index);
+    uint64_t getKeyIndexByKey(uint64_t key);
+    // Get the index of the newest version of the key with a sequence number <= sequence
+    uint64_t getKeyIndexByKey(uint64_t key, uint64_t sequence);
+    // Get the index of the first key >= key, the key num if none
+    uint64_t getLowerBoundIndex(uint64_t key);
+    // std::string getSStableValue(size_t index);
+
+    bool checkIfKeyExist(uint64_t targetKey);
+    // Same check with the hash computed once by the caller
+    bool checkIfKeyExist(uint64_t targetKey, const KeyHash &keyHash);
+    // Check if [key1, key2] may hold a key of the sstable, by the fences and the range filter
+    bool checkIfRangeExist(uint64_t key1, uint64_t key2);
+
+    SStable();
+    ~SStable();
 };
\ No newline at end of file
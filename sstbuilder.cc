@@ -0,0 +1,61 @@
+#include "sstbuilder.h"
+
+// Constructor
+SStableBuilder::SStableBuilder(std::string dirPath, uint64_t timeStamp, int filterFormat,
+    double bitsPerKey, double rangeBitsPerPrefix, std::function<uint64_t()> newFileID,
+    RateLimiter* rateLimiter) {
+    this->dirPath = dirPath;
+    this->timeStamp = timeStamp;
+    this->filterFormat = filterFormat;
+    this->bitsPerKey = bitsPerKey;
+    this->rangeBitsPerPrefix = rangeBitsPerPrefix;
+    this->newFileID = newFileID;
+    this->rateLimiter = rateLimiter;
+    this->fileSize = sstable_headerSize + sstable_bfSize;
+}
+
+/****************************************************************************************
+ **                                 Private functions                                  **
+ ****************************************************************************************/
+
+// Write the entries held into a new sstable
+void SStableBuilder::flush() {
+    if (this->entries.empty())
+        return;
+
+    // Charge the file before it is written
+    if (this->rateLimiter != nullptr)
+        this->rateLimiter->request(SStable::estimateFileSize(this->entries.size(), this->filterFormat,
+            this->bitsPerKey, this->rangeBitsPerPrefix), ratelimit_low);
+
+    uint64_t fileID = this->newFileID();
+    std::string path = this->dirPath + "/" + std::to_string(fileID) + ".sst";
+    std::shared_ptr<SStable> sstable = std::make_shared<SStable>(this->timeStamp, this->entries, path,
+        this->filterFormat, this->bitsPerKey, this->rangeBitsPerPrefix);
+    this->sstables[fileID] = sstable;
+
+    this->entries.clear();
+    this->fileSize = sstable_headerSize + sstable_bfSize;
+}
+
+/****************************************************************************************
+ **                                 Public functions                                   **
+ ****************************************************************************************/
+
+// Add the next entry, a full sstable is written before a new key
+void SStableBuilder::add(const IndexEntry &entry) {
+    uint64_t addSize = sstable_keySize + sstable_offsetSize + sstable_vlenSize;
+
+    bool isNewKey = this->entries.empty() || entry.key != this->entries.back().key;
+    if (isNewKey && this->fileSize + addSize > sstable_maxSize)
+        this->flush();
+
+    this->fileSize += addSize;
+    this->entries.push_back(entry);
+}
+
+// Write the last sstable
+std::map<uint64_t, std::shared_ptr<SStable> > &SStableBuilder::finish() {
+    this->flush();
+    return this->sstables;
+}
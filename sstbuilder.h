@@ -0,0 +1,54 @@
+#pragma once
+#include "sstable.h"
+#include "ratelimiter.h"
+#include "config.h"
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+/****************************************************************
+    SStableBuilder: cut a stream of index entries into sstables
+    The entries come sorted by key, newest first for each key,
+    only the entries of the sstable being filled are held
+    A new sstable starts at a key boundary once the current one
+    reaches sstable_maxSize, the versions of a key stay together
+    Each sstable is charged to the rate limiter before it is written
+****************************************************************/
+
+class SStableBuilder {
+private:
+    // Directory and settings of the new sstables
+    std::string dirPath;
+    uint64_t timeStamp;
+    int filterFormat;
+    double bitsPerKey;
+    double rangeBitsPerPrefix;
+    // Give the file id of the next sstable
+    std::function<uint64_t()> newFileID;
+    // Paces the writes at low priority, nullptr for no limit
+    RateLimiter* rateLimiter;
+
+    // Entries of the sstable being filled and its size
+    std::vector<IndexEntry> entries;
+    uint64_t fileSize;
+
+    // The finished sstables by file id
+    std::map<uint64_t, std::shared_ptr<SStable> > sstables;
+
+    // Write the entries held into a new sstable
+    void flush();
+
+public:
+    SStableBuilder(std::string dirPath, uint64_t timeStamp, int filterFormat,
+        double bitsPerKey, double rangeBitsPerPrefix, std::function<uint64_t()> newFileID,
+        RateLimiter* rateLimiter = nullptr);
+    ~SStableBuilder(){};
+
+    // Add the next entry
+    void add(const IndexEntry &entry);
+    // Write the last sstable, return all the sstables built
+    std::map<uint64_t, std::shared_ptr<SStable> > &finish();
+};
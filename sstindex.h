@@ -1,42 +1,71 @@
-#pragma once
-
-#include <cstdint>
-#include <vector>
-#include <string>
-#include <iostream>
-#include <fstream>
-
-class SSTIndex {
-private:
-    uint64_t keyNum;
-    std::vector<uint64_t> keyVec;
-    std::vector<uint64_t> offsetVec;
-    std::vector<uint64_t> vlenVec;
-
-public:
-    // Constructor
-    SSTIndex(){keyNum = 0;};
-    SSTIndex(std::string path, uint64_t offset, size_t readKeyNum);
-
-    // Destructor
-    ~SSTIndex(){};
-
-    // Get the number of keys
-    uint64_t getKeyNum() {return this->keyNum;};
-    // Get the key from the vector
-    uint64_t getKey(uint64_t index);
-    // Get the offset from the vector
-    uint64_t getOffset(uint64_t index);
-    // Get the value length from the vector
-    uint64_t getVlen(uint64_t index);
-    // Get the index of the key
-    uint64_t getIndex(uint64_t key);
-
-    // Insert a <key, offset, vlen> into the vector
-    void insert(uint64_t newKey, uint64_t newOffset, uint64_t newVlen);
-
-    // Load the sstindex from the file
-    int readFile(std::string path, uint64_t offset, size_t readKeyNum);
-    // Write the sstindex to the file
-    uint64_t writeToFile(std::string path, uint64_t offset);
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <iostream>
+#include <fstream>
+
+// Entry of the index, the versions of a key follow each other newest first
+struct IndexEntry {
+    uint64_t key;
+    uint64_t offset;
+    uint64_t vlen;
+    uint64_t seq;
+};
+
+/****************************************************************
+    Index of an sstable: Key + Offset + Vlen, 8Byte each, per entry
+    The sequence numbers of the entries are stored at the end of
+    the file: Seqs(keyNum * 8Byte) + Magic(4Byte) + Reserved(4Byte)
+    The entries of a table written without them have sequence
+    number 0, older than every other version
+****************************************************************/
+
+class SSTIndex {
+private:
+    uint64_t keyNum;
+    std::vector<uint64_t> keyVec;
+    std::vector<uint64_t> offsetVec;
+    std::vector<uint64_t> vlenVec;
+    std::vector<uint64_t> seqVec;
+    // Largest sequence number of the entries
+    uint64_t maxSeq = 0;
+
+public:
+    // Constructor
+    SSTIndex(){keyNum = 0;};
+    SSTIndex(std::string path, uint64_t offset, size_t readKeyNum);
+
+    // Destructor
+    ~SSTIndex(){};
+
+    // Get the number of keys
+    uint64_t getKeyNum() {return this->keyNum;};
+    // Get the key from the vector
+    uint64_t getKey(uint64_t index);
+    // Get the offset from the vector
+    uint64_t getOffset(uint64_t index);
+    // Get the value length from the vector
+    uint64_t getVlen(uint64_t index);
+    // Get the sequence number from the vector
+    uint64_t getSeq(uint64_t index);
+    uint64_t getMaxSeq() {return this->maxSeq;};
+    // Get the index of the newest version of the key
+    uint64_t getIndex(uint64_t key);
+    // Get the index of the first key >= key, keyNum if none
+    uint64_t lowerBound(uint64_t key);
+
+    // Insert a <key, offset, vlen, seq> into the vector
+    void insert(uint64_t newKey, uint64_t newOffset, uint64_t newVlen, uint64_t newSeq = 0);
+
+    // Load the sstindex from the file
+    int readFile(std::string path, uint64_t offset, size_t readKeyNum);
+    // Write the sstindex to the file
+    uint64_t writeToFile(std::string path, uint64_t offset);
+
+    // Load the sequence numbers from the end of the file
+    int readSeqs(std::string path);
+    // Append the sequence numbers to the end of the file
+    int writeSeqs(std::string path);
 };
\ No newline at end of file
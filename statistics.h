@@ -0,0 +1,35 @@
+#pragma once
+#include <cstdint>
+
+// Counters of a KVStore, taken at one moment by getStatistics
+struct Statistics {
+    // Value cache: gets and scans served without reading the vLog
+    uint64_t valueCacheHits = 0;
+    // Value cache: reads that went to the vLog
+    uint64_t valueCacheMisses = 0;
+
+    // Scan: sstables skipped by their fences or range filter
+    uint64_t scanSSTablesSkipped = 0;
+    // Scan: sstables read
+    uint64_t scanSSTablesScanned = 0;
+
+    // Write: key and value bytes given to put, del and write
+    uint64_t bytesIngested = 0;
+    // Write: vLog and sstable bytes written by the flushes
+    uint64_t flushBytesWritten = 0;
+    // Write: sstable bytes written by the merges
+    uint64_t compactionBytesWritten = 0;
+    // Write: microseconds the flushes, merges and gc relocations waited for the rate limiter
+    uint64_t rateLimiterWaitMicros = 0;
+
+    // Write: bytes written to disk per byte ingested
+    double writeAmplification() const {
+        return bytesIngested == 0 ? 0 : (double)(flushBytesWritten + compactionBytesWritten) / bytesIngested;
+    };
+
+    // Scan: share of the sstables skipped
+    double scanSkipRate() const {
+        uint64_t total = scanSSTablesSkipped + scanSSTablesScanned;
+        return total == 0 ? 0 : (double)scanSSTablesSkipped / total;
+    };
+};
@@ -186,17 +186,28 @@ namespace utils
     /**
      * generate crc16
      * @param data binary data used to generate crc16.
+     * @param length number of bytes in data.
      * @return generated crc16.
      */
-    static inline uint16_t crc16(const std::vector<unsigned char> &data)
+    static inline uint16_t crc16(const unsigned char *data, size_t length)
     {
         static const std::unique_ptr<uint16_t[]> crc16_table = generate_crc16_table();
         uint16_t crc = 0xFFFF;
-        size_t i = 0, length = data.size();
+        size_t i = 0;
         while (i < length)
         {
             crc = (crc << 8) ^ crc16_table[((crc >> 8) ^ data[i++]) & 0xFF];
         }
         return crc;
     }
+
+    /**
+     * generate crc16
+     * @param data binary data used to generate crc16.
+     * @return generated crc16.
+     */
+    static inline uint16_t crc16(const std::vector<unsigned char> &data)
+    {
+        return crc16(data.data(), data.size());
+    }
 }
@@ -1,302 +1,359 @@
-#include "vLog.h"
-#include <cstdint>
-#include <fstream>
-
-// Constructor
-vLog::vLog(std::string path){
-    this->path = path;
-    this->tail = 0;
-    this->head = 0;
-}
-
-// Write the vLog to a file
-uint64_t vLog::writeToFile(uint64_t offset){
-    bool ifFileExists = false;
-    uint64_t fileSize = 0;
-    std::ifstream inFile(this->path, std::ios::in | std::ios::binary);
-   
-    // Check if the file exists
-    if(inFile){
-        ifFileExists = true;
-        inFile.seekg(0, std::ios::end);
-        fileSize = inFile.tellg();
-        inFile.close();
-    }
-
-    // If the file does not exist, create it
-    if(!ifFileExists){
-        offset = 0;
-        std::ofstream outFile(path, std::ios::out | std::ios::binary);
-        outFile.close();
-    } else if(ifFileExists && (offset > fileSize)){
-        offset = fileSize;
-    }
-
-    // Open the file for writing
-    std::fstream outFile(path, std::ios::out | std::ios::in | std::ios::binary);
-
-    if(!outFile)
-        return -1;
-
-    // Seek to the offset
-    outFile.seekp(offset, std::ios::beg);
-
-    for(size_t i = 0; i < this->entries.size(); i++){
-        vLogEntry entry = this->entries[i];
-        
-        // Write the entry to the file
-        outFile.write((char*)&entry.Magic, sizeof(uint8_t));
-        outFile.write((char*)&entry.Checksum, sizeof(uint16_t));
-        outFile.write((char*)&entry.Key, sizeof(uint64_t));
-        outFile.write((char*)&entry.vlen, sizeof(uint32_t));
-        outFile.write((char*)&entry.Value, entry.Value.size());
-    }
-
-    // Update the offset
-    this->head = outFile.tellp();
-
-    outFile.close();
-
-    //  Clear the entries
-    this->entries.clear();
-
-    return offset;
-}
-
-// Insert a new value
-void vLog::insert(uint64_t Key, std::string newVal){
-    // Create a new vLogEntry
-    vLogEntry entry(Key, newVal);
-
-    // Add the entry to the entries vector
-    this->entries.push_back(entry);
-    head++;
-}
-
-// Get the value from a file
-std::string vLog::getValFromFile(std::string path, uint64_t offset, uint32_t length){
-    std::ifstream inFile(path, std::ios::in | std::ios::binary);
-    if(!inFile)
-        return sstvalue_readFile_file;
-
-    // Move fp to the end
-    inFile.seekg(0, std::ios::end);
-    // Get the file size
-    size_t fileSize = inFile.tellg();
-
-    // Check if the offset is out of range
-    if(offset > fileSize || (offset + length) > fileSize){
-        inFile.close();
-        return sstvalue_outOfRange;
-    }
-
-    // Check if the offset is within the valid range
-    if(offset <= tail || offset >= head){
-        inFile.close();
-        return sstvalue_outOfRange;
-    }
-    
-    // Move fp to the offset
-    inFile.seekg(offset, std::ios::beg);
-
-    // Read the value
-    char* buffer = new char[length];
-    inFile.read(buffer, length);
-
-    // Copy the buffer to a string for free
-    std::string res = "";
-    for(size_t i = 0; i < length; i++)
-        res += buffer[i];
-
-    inFile.close();
-
-    // Free the buffer
-    delete[] buffer;
-
-    return res;
-}
-
-// Read the key from a file
-uint64_t vLog::getKeyFromFile(std::string path, uint64_t offset){
-    std::ifstream inFile(path, std::ios::in | std::ios::binary);
-    if(!inFile)
-        return -1;
-
-    // Move fp to the end
-    inFile.seekg(0, std::ios::end);
-    // Get the file size
-    size_t fileSize = inFile.tellg();
-
-    // Check if the offset is out of range
-    if(offset > fileSize){
-        inFile.close();
-        return -1;
-    }
-
-    // Check if the offset is within the valid range
-    if(offset <= tail || offset >= head){
-        inFile.close();
-        return -1;
-    }
-    
-    // Move fp to the offset
-    // Key(8 Byte)->vlen(4 Byte)->Value
-    inFile.seekg(offset-12, std::ios::beg);
-
-    // Read the value
-    char* buffer = new char[sizeof(uint64_t)];
-    inFile.read(buffer, sizeof(uint64_t));
-
-    // Convert the buffer to uint64_t
-    uint64_t res = atoi(buffer);
-
-    inFile.close();
-
-    // Free the buffer
-    delete[] buffer;
-
-    return res;
-    
-}
-
-// Read the vlen from a file
-uint32_t vLog::getVlenFromFile(std::string path, uint64_t offset){
-    std::ifstream inFile(path, std::ios::in | std::ios::binary);
-    if(!inFile)
-        return -1;
-
-    // Move fp to the end
-    inFile.seekg(0, std::ios::end);
-    // Get the file size
-    size_t fileSize = inFile.tellg();
-
-    // Check if the offset is out of range
-    if(offset > fileSize){
-        inFile.close();
-        return -1;
-    }
-
-    // Check if the offset is within the valid range
-    if(offset <= tail || offset >= head){
-        inFile.close();
-        return -1;
-    }
-    
-    // Move fp to the offset
-    // Key(8 Byte)->vlen(4 Byte)->Value
-    inFile.seekg(offset-4, std::ios::beg);
-
-    // Read the value
-    char* buffer = new char[sizeof(uint64_t)];
-    inFile.read(buffer, sizeof(uint64_t));
-
-    // Convert the buffer to uint64_t
-    uint32_t res = atoi(buffer);
-
-    inFile.close();
-
-    // Free the buffer
-    delete[] buffer;
-
-    return res;
-    
-}
-
-// Read Magic from a file
-uint8_t vLog::getMagicFromFile(std::string path, uint64_t offset){
-    std::ifstream inFile(path, std::ios::in | std::ios::binary);
-    if(!inFile)
-        return -1;
-
-    // Move fp to the end
-    inFile.seekg(0, std::ios::end);
-    // Get the file size
-    size_t fileSize = inFile.tellg();
-
-    // Check if the offset is out of range
-    if(offset > fileSize){
-        inFile.close();
-        return -1;
-    }
-
-    // Check if the offset is within the valid range
-    if(offset <= tail || offset >= head){
-        inFile.close();
-        return -1;
-    }
-    
-    // Move fp to the offset
-    // Magic(1 Byte) -> Checksum(2 Byte) -> Key(8 Byte) -> vlen(4 Byte) -> Value
-    inFile.seekg(offset-15, std::ios::beg);
-
-    // Read the value
-    char* buffer = new char[sizeof(uint64_t)];
-    inFile.read(buffer, sizeof(uint64_t));
-
-    // Convert the buffer to uint64_t
-    uint32_t res = atoi(buffer);
-
-    inFile.close();
-
-    // Free the buffer
-    delete[] buffer;
-
-    return res;
-    
-}
-
-// Read Checksum from a file
-uint16_t vLog::getChecksumFromFile(std::string path, uint64_t offset){
-    std::ifstream inFile(path, std::ios::in | std::ios::binary);
-    if(!inFile)
-        return -1;
-
-    // Move fp to the end
-    inFile.seekg(0, std::ios::end);
-    // Get the file size
-    size_t fileSize = inFile.tellg();
-
-    // Check if the offset is out of range
-    if(offset > fileSize){
-        inFile.close();
-        return -1;
-    }
-
-    // Check if the offset is within the valid range
-    if(offset <= tail || offset >= head){
-        inFile.close();
-        return -1;
-    }
-    
-    // Move fp to the offset
-    // Magic(1 Byte) -> Checksum(2 Byte) -> Key(8 Byte) -> vlen(4 Byte) -> Value
-    inFile.seekg(offset-14, std::ios::beg);
-
-    // Read the value
-    char* buffer = new char[sizeof(uint64_t)];
-    inFile.read(buffer, sizeof(uint64_t));
-
-    // Convert the buffer to uint64_t
-    uint32_t res = atoi(buffer);
-
-    inFile.close();
-
-    // Free the buffer
-    delete[] buffer;
-
-    return res;
-    
-}
-
-// Read the vLog from a list
-void vLog::readFromList(std::list<std::pair<uint64_t, std::string>> list){
-    for(auto iter = list.begin(); iter != list.end(); iter++){
-        // Skip empty values
-        if(iter->second.size() == 0)
-            continue;
-
-        // Create a new vLogEntry
-        vLogEntry entry(iter->first, iter->second);
-        this->entries.push_back(entry);
-    }
+#include "vLog.h"
+#include <cstdint>
+#include <algorithm>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <climits>
+
+// Constructor
+vLog::vLog(std::string path, int readMode, uint64_t preallocSize){
+    this->path = path;
+    this->tail = 0;
+    this->head = 0;
+    this->readMode = readMode;
+    this->mapping = nullptr;
+    this->batchWritten = 0;
+    this->preallocSize = preallocSize;
+    this->rateLimiter = nullptr;
+    this->ratePriority = ratelimit_high;
+    this->buffer.reserve(vlog_buffer_size);
+
+    // Continue after the entries written before
+    std::ifstream inFile(path, std::ios::in | std::ios::binary);
+    if(inFile){
+        inFile.seekg(0, std::ios::end);
+        this->head = inFile.tellg();
+        inFile.close();
+    }
+
+    // Open the file once for all the reads and appends, create it if it does not exist
+    this->fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if(this->fd < 0)
+        perror("open");
+    this->allocatedEnd = this->head;
+
+    // gc punched the entries before the first data block, the tail is the first entry after them
+    off_t data = (this->fd < 0) ? -1 : lseek(this->fd, 0, SEEK_DATA);
+    this->tail = (data < 0) ? this->head.load() : this->findEntry(data);
+}
+
+// Destructor
+vLog::~vLog(){
+    for(Mapping* m : this->mappings){
+        munmap(m->data, m->size);
+        delete m;
+    }
+    if(this->fd >= 0)
+        close(this->fd);
+}
+
+// Write the buffer after the part of the batch already written
+bool vLog::writeBuffer(){
+    uint64_t offset = this->head + this->batchWritten;
+
+    // Reserve the blocks ahead so that appends do not allocate them one by one
+    if(this->preallocSize > 0 && offset + this->buffer.size() > this->allocatedEnd){
+        uint64_t allocSize = std::max<uint64_t>(this->preallocSize, this->buffer.size());
+        if(fallocate(this->fd, FALLOC_FL_KEEP_SIZE, offset, allocSize) == 0)
+            this->allocatedEnd = offset + allocSize;
+    }
+
+    // One pwrite for the whole buffer, or one per burst that the rate limiter lets through
+    const char* data = this->buffer.data();
+    size_t length = this->buffer.size();
+    uint64_t burst = (this->rateLimiter == nullptr) ? length : this->rateLimiter->getSingleBurstBytes();
+    while(length > 0){
+        size_t piece = std::min<uint64_t>(length, burst);
+        if(this->rateLimiter != nullptr)
+            this->rateLimiter->request(piece, this->ratePriority);
+
+        while(piece > 0){
+            ssize_t written = pwrite(this->fd, data, piece, offset);
+            if(written < 0){
+                perror("pwrite");
+                return false;
+            }
+            data += written;
+            offset += written;
+            length -= written;
+            piece -= written;
+        }
+    }
+
+    this->batchWritten += this->buffer.size();
+    this->buffer.clear();
+    return true;
+}
+
+// Append the inserted values to the file
+uint64_t vLog::writeToFile(){
+    uint64_t offset = this->head;
+
+    if(this->fd < 0 || !this->writeBuffer())
+        return -1;
+
+    // Readers may only see the batch once it is durable
+    if(this->batchWritten > 0){
+        fdatasync(this->fd);
+        this->head = offset + this->batchWritten;
+    }
+    this->batchWritten = 0;
+
+    return offset;
+}
+
+// Insert a new value
+void vLog::insert(uint64_t Key, const std::string &newVal){
+    uint8_t magic = 0xff;
+    uint16_t checksum = 0;
+    uint32_t vlen = newVal.size();
+
+    // Magic(1Byte) + Checksum(2Byte) + Key(8Byte) + vlen(4Byte) + Value
+    size_t start = this->buffer.size();
+    this->buffer.append(reinterpret_cast<const char*>(&magic), sizeof(magic));
+    this->buffer.append(reinterpret_cast<const char*>(&checksum), sizeof(checksum));
+    this->buffer.append(reinterpret_cast<const char*>(&Key), sizeof(Key));
+    this->buffer.append(reinterpret_cast<const char*>(&vlen), sizeof(vlen));
+    this->buffer.append(newVal);
+
+    // The checksum covers Key, vlen and Value, which are already in the buffer
+    size_t covered = start + sizeof(magic) + sizeof(checksum);
+    checksum = utils::crc16(reinterpret_cast<const unsigned char*>(this->buffer.data()) + covered, this->buffer.size() - covered);
+    memcpy(&this->buffer[start + sizeof(magic)], &checksum, sizeof(checksum));
+
+    // Write a full buffer out, head stays until the whole batch is durable
+    if(this->buffer.size() >= vlog_buffer_size)
+        this->writeBuffer();
+}
+
+// Read length bytes at offset into buffer
+bool vLog::readAt(uint64_t offset, void* buffer, size_t length){
+    char* dst = static_cast<char*>(buffer);
+    while(length > 0){
+        ssize_t readBytes = pread(this->fd, dst, length, offset);
+        if(readBytes <= 0)
+            return false;
+        dst += readBytes;
+        offset += readBytes;
+        length -= readBytes;
+    }
+    return true;
+}
+
+// Get a mapping covering [0, end)
+vLog::Mapping* vLog::getMapping(uint64_t end){
+    Mapping* cur = this->mapping.load(std::memory_order_acquire);
+    if(cur != nullptr && end <= cur->size)
+        return cur;
+
+    std::lock_guard<std::mutex> lock(this->mappingMutex);
+
+    // Another reader may have remapped meanwhile
+    cur = this->mapping.load(std::memory_order_acquire);
+    if(cur != nullptr && end <= cur->size)
+        return cur;
+
+    // Double the size so that the file is remapped only a few times as head grows
+    // The pages past the end of the file are never touched, reads stop at head
+    uint64_t pageSize = sysconf(_SC_PAGESIZE);
+    uint64_t size = std::max<uint64_t>(end, (cur == nullptr) ? pageSize : cur->size * 2);
+    size = (size + pageSize - 1) / pageSize * pageSize;
+
+    void* data = mmap(nullptr, size, PROT_READ, MAP_SHARED, this->fd, 0);
+    if(data == MAP_FAILED){
+        perror("mmap");
+        return nullptr;
+    }
+
+    Mapping* newMapping = new Mapping{static_cast<char*>(data), size};
+    this->mappings.push_back(newMapping);
+    this->mapping.store(newMapping, std::memory_order_release);
+    return newMapping;
+}
+
+// Get the value from a file
+std::string vLog::getValFromFile(uint64_t offset, uint32_t length){
+    if(this->fd < 0)
+        return sstvalue_readFile_file;
+
+    // Check if the offset is within the valid range, head never passes the file size
+    // gc moves tail past the holes it digs, so a mapping never shows their zeros
+    if(offset <= tail || offset >= head || (offset + length) > head)
+        return sstvalue_outOfRange;
+
+    // Copy the value out of the page cache without a syscall
+    if(this->readMode == vlog_read_mmap){
+        Mapping* m = this->getMapping(offset + length);
+        if(m == nullptr)
+            return sstvalue_readFile_file;
+        return std::string(m->data + offset, length);
+    }
+
+    // Read the value straight into the result
+    std::string res(length, '\0');
+    if(!this->readAt(offset, &res[0], length))
+        return sstvalue_outOfRange;
+
+    return res;
+}
+
+// Read the values at the sorted (offset, vlen) pairs
+void vLog::getValsFromFile(const std::vector<std::pair<uint64_t, uint32_t> > &requests,
+                           std::vector<std::string> &values, uint64_t maxGap){
+    values.assign(requests.size(), std::string());
+
+    // The mapping already serves each value without a syscall
+    if(this->fd < 0 || this->readMode == vlog_read_mmap){
+        for(size_t i = 0; i < requests.size(); i++)
+            values[i] = this->getValFromFile(requests[i].first, requests[i].second);
+        return;
+    }
+
+    // The bytes between two values of a group are read into it and dropped
+    std::string gap(maxGap, '\0');
+    std::vector<struct iovec> iov;
+
+    size_t i = 0;
+    while(i < requests.size()){
+        uint64_t offset = requests[i].first;
+        uint32_t length = requests[i].second;
+        if(offset <= tail || offset >= head || offset + length > head){
+            values[i++] = sstvalue_outOfRange;
+            continue;
+        }
+
+        // Grow the group while the next value is valid and close enough
+        values[i].resize(length);
+        iov.clear();
+        iov.push_back({&values[i][0], length});
+        uint64_t groupStart = offset, groupEnd = offset + length;
+        size_t first = i++;
+        while(i < requests.size() && iov.size() + 2 <= IOV_MAX){
+            uint64_t nextOffset = requests[i].first;
+            uint32_t nextLength = requests[i].second;
+            if(nextOffset < groupEnd || nextOffset - groupEnd > maxGap || nextOffset + nextLength > head)
+                break;
+            if(nextOffset > groupEnd)
+                iov.push_back({&gap[0], nextOffset - groupEnd});
+            values[i].resize(nextLength);
+            iov.push_back({&values[i][0], nextLength});
+            groupEnd = nextOffset + nextLength;
+            i++;
+        }
+
+        // Fall back to one read per value on a short read
+        ssize_t readBytes = preadv(this->fd, iov.data(), iov.size(), groupStart);
+        if(readBytes == (ssize_t)(groupEnd - groupStart))
+            continue;
+        for(size_t j = first; j < i; j++){
+            if(!this->readAt(requests[j].first, &values[j][0], requests[j].second))
+                values[j] = sstvalue_outOfRange;
+        }
+    }
+}
+
+// Find the first valid entry at or after offset
+uint64_t vLog::findEntry(uint64_t offset){
+    uint64_t key;
+    std::string value;
+    for(; offset + 15 <= this->head; offset++){
+        if(this->readEntry(offset + 15, key, value))
+            return offset;
+    }
+    return this->head;
+}
+
+// Read the key from a file
+uint64_t vLog::getKeyFromFile(uint64_t offset){
+    // Check if the offset is within the valid range
+    if(this->fd < 0 || offset <= tail || offset >= head)
+        return -1;
+
+    // Key(8 Byte)->vlen(4 Byte)->Value
+    uint64_t res;
+    if(!this->readAt(offset - 12, &res, sizeof(res)))
+        return -1;
+    return res;
+}
+
+// Read the vlen from a file
+uint32_t vLog::getVlenFromFile(uint64_t offset){
+    // Check if the offset is within the valid range
+    if(this->fd < 0 || offset <= tail || offset >= head)
+        return -1;
+
+    // Key(8 Byte)->vlen(4 Byte)->Value
+    uint32_t res;
+    if(!this->readAt(offset - 4, &res, sizeof(res)))
+        return -1;
+    return res;
+}
+
+// Read Magic from a file
+uint8_t vLog::getMagicFromFile(uint64_t offset){
+    // Check if the offset is within the valid range
+    if(this->fd < 0 || offset <= tail || offset >= head)
+        return -1;
+
+    // Magic(1 Byte) -> Checksum(2 Byte) -> Key(8 Byte) -> vlen(4 Byte) -> Value
+    uint8_t res;
+    if(!this->readAt(offset - 15, &res, sizeof(res)))
+        return -1;
+    return res;
+}
+
+// Read Checksum from a file
+uint16_t vLog::getChecksumFromFile(uint64_t offset){
+    // Check if the offset is within the valid range
+    if(this->fd < 0 || offset <= tail || offset >= head)
+        return -1;
+
+    // Magic(1 Byte) -> Checksum(2 Byte) -> Key(8 Byte) -> vlen(4 Byte) -> Value
+    uint16_t res;
+    if(!this->readAt(offset - 14, &res, sizeof(res)))
+        return -1;
+    return res;
+}
+
+// Read the entry whose value starts at offset
+bool vLog::readEntry(uint64_t offset, uint64_t &key, std::string &value){
+    // The header lies between tail and head, an empty value may start at head
+    if(this->fd < 0 || offset < this->tail + 15 || offset > this->head)
+        return false;
+
+    // Magic(1 Byte) -> Checksum(2 Byte) -> Key(8 Byte) -> vlen(4 Byte) -> Value
+    unsigned char header[15];
+    if(!this->readAt(offset - 15, header, sizeof(header)))
+        return false;
+
+    uint8_t magic = header[0];
+    uint16_t checksum;
+    uint32_t vlen;
+    memcpy(&checksum, header + 1, sizeof(checksum));
+    memcpy(&key, header + 3, sizeof(key));
+    memcpy(&vlen, header + 11, sizeof(vlen));
+
+    // A hole reads as zeros, the magic tells it apart
+    if(magic != 0xff || offset + vlen > this->head)
+        return false;
+
+    // The checksum covers Key, vlen and Value
+    std::string data(reinterpret_cast<char*>(header + 3), 12);
+    value.resize(vlen);
+    if(vlen > 0 && !this->readAt(offset, &value[0], vlen))
+        return false;
+    data += value;
+    return utils::crc16(reinterpret_cast<const unsigned char*>(data.data()), data.size()) == checksum;
+}
+
+// Read the vLog from a list
+void vLog::readFromList(const std::list<std::pair<uint64_t, std::string>> &list){
+    // Empty values are written as well, the sstable counts an entry for each of them
+    for(auto iter = list.begin(); iter != list.end(); iter++)
+        this->insert(iter->first, iter->second);
 }
\ No newline at end of file
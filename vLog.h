@@ -1,95 +1,145 @@
-#pragma once
-
-#include <cstdint>
-#include <string>
-#include <iostream>
-#include <fstream>
-#include <vector>
-#include <list>
-#include "config.h"
-#include "utils.h"
-
-class vLogEntry{
-public:
-    // vLog entry fields
-    uint8_t Magic;
-    uint16_t Checksum;
-    uint64_t Key;
-    uint32_t vlen;
-    std::string Value;
-
-    // Default constructor
-    vLogEntry(){Magic = 0xff;};
-
-    // Parameterized constructor
-    vLogEntry(uint64_t key, std::string value){
-    this->Magic = 0xff;
-    this->Key = key;
-    this->Value = value;
-    this->vlen = value.size();
-
-    std::vector<unsigned char> data;
-
-    // Add Key to data
-    unsigned char* keyPtr = reinterpret_cast<unsigned char*>(&this->Key);
-    for (size_t i = 0; i < sizeof(this->Key); ++i) {
-        data.push_back(keyPtr[i]);
-    }
-
-    // Add vlen to data
-    unsigned char* vlenPtr = reinterpret_cast<unsigned char*>(&this->vlen);
-    for (size_t i = 0; i < sizeof(this->vlen); ++i) {
-        data.push_back(vlenPtr[i]);
-    }
-
-    // Add Value to data
-    for (const char& c : this->Value) {
-        data.push_back(static_cast<unsigned char>(c));
-    }
-
-    this->Checksum = utils::crc16(data);
-};
-
-    // Destructor
-    ~vLogEntry(){};
-};
-
-class vLog{
-private:
-    std::string path;
-    uint64_t tail, head;
-    std::vector<vLogEntry> entries;
-
-public:
-    // Get the number of values in the vLog
-    uint64_t getHead(){return head;};
-    uint64_t getTail(){return tail;};
-    void setTail(uint64_t newTail){this->tail = newTail;};
-
-    // Get the vLog path
-    std::string getPath(){return path;};
-
-    // Insert a new value
-    void insert(uint64_t Key, std::string newVal);
-
-    // Write the vLog to a file
-    uint64_t writeToFile(uint64_t offset);
-
-    // Read the value from a file
-    std::string getValFromFile(std::string path, uint64_t offset, uint32_t length);
-    // Read the key from a file
-    uint64_t getKeyFromFile(std::string path, uint64_t offset);
-    // Read the vlen from a file
-    uint32_t getVlenFromFile(std::string path, uint64_t offset);
-    // Read Magic from a file
-    uint8_t getMagicFromFile(std::string path, uint64_t offset);
-    // Read Checksum from a file
-    uint16_t getChecksumFromFile(std::string path, uint64_t offset);
-
-    // Read the vLog from a list
-    void readFromList(std::list<std::pair<uint64_t, std::string>>);
-
-    // Default constructor and destructor
-    vLog(std::string path);
-    ~vLog(){};
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <list>
+#include <atomic>
+#include <mutex>
+#include "config.h"
+#include "ratelimiter.h"
+#include "utils.h"
+
+class vLogEntry{
+public:
+    // vLog entry fields
+    uint8_t Magic;
+    uint16_t Checksum;
+    uint64_t Key;
+    uint32_t vlen;
+    std::string Value;
+
+    // Default constructor
+    vLogEntry(){Magic = 0xff;};
+
+    // Parameterized constructor
+    vLogEntry(uint64_t key, std::string value){
+    this->Magic = 0xff;
+    this->Key = key;
+    this->Value = value;
+    this->vlen = value.size();
+
+    std::vector<unsigned char> data;
+
+    // Add Key to data
+    unsigned char* keyPtr = reinterpret_cast<unsigned char*>(&this->Key);
+    for (size_t i = 0; i < sizeof(this->Key); ++i) {
+        data.push_back(keyPtr[i]);
+    }
+
+    // Add vlen to data
+    unsigned char* vlenPtr = reinterpret_cast<unsigned char*>(&this->vlen);
+    for (size_t i = 0; i < sizeof(this->vlen); ++i) {
+        data.push_back(vlenPtr[i]);
+    }
+
+    // Add Value to data
+    for (const char& c : this->Value) {
+        data.push_back(static_cast<unsigned char>(c));
+    }
+
+    this->Checksum = utils::crc16(data);
+};
+
+    // Destructor
+    ~vLogEntry(){};
+};
+
+class vLog{
+private:
+    std::string path;
+    // head is the end of the durable entries, readers never go past it
+    std::atomic<uint64_t> tail, head;
+
+    // Kept open for all the reads and writes, pread/pwrite do not move a shared position
+    int fd;
+
+    // Entries waiting for writeToFile, encoded as in the file
+    std::string buffer;
+    // Bytes of the batch already written before head, when it is larger than the buffer
+    uint64_t batchWritten;
+    // End of the region reserved with fallocate
+    uint64_t preallocSize;
+    uint64_t allocatedEnd;
+    // Paces the writes a burst at a time, nullptr for no limit
+    RateLimiter* rateLimiter;
+    int ratePriority;
+
+    // vlog_read_pread or vlog_read_mmap
+    int readMode;
+
+    // A read-only mapping of the file, it may reach past the end of the file
+    struct Mapping {
+        char* data;
+        uint64_t size;
+    };
+    // The largest mapping, readers load it without a lock
+    std::atomic<Mapping*> mapping;
+    // All the mappings made, the smaller ones stay valid for the readers still using them
+    std::vector<Mapping*> mappings;
+    std::mutex mappingMutex;
+
+    // Read length bytes at offset into buffer, return false on a short read
+    bool readAt(uint64_t offset, void* buffer, size_t length);
+    // Write the buffer after the part of the batch already written
+    bool writeBuffer();
+    // Get a mapping covering [0, end)
+    Mapping* getMapping(uint64_t end);
+    // Find the first valid entry at or after offset, head if there is none
+    uint64_t findEntry(uint64_t offset);
+
+public:
+    // Get the number of values in the vLog
+    uint64_t getHead(){return head;};
+    uint64_t getTail(){return tail;};
+    void setTail(uint64_t newTail){this->tail = newTail;};
+
+    // Get the vLog path
+    std::string getPath(){return path;};
+
+    // Insert a new value
+    void insert(uint64_t Key, const std::string &newVal);
+
+    // Charge the writes to the rate limiter before each burst goes to the file
+    void setRateLimiter(RateLimiter* rateLimiter, int priority){this->rateLimiter = rateLimiter; this->ratePriority = priority;};
+
+    // Append the inserted values to the file, return the offset they start at
+    // head moves past them once they are durable
+    uint64_t writeToFile();
+
+    // Read the value from a file
+    std::string getValFromFile(uint64_t offset, uint32_t length);
+    // Read the values at the sorted (offset, vlen) pairs, the values closer than maxGap
+    // are fetched by one preadv
+    void getValsFromFile(const std::vector<std::pair<uint64_t, uint32_t> > &requests,
+                         std::vector<std::string> &values, uint64_t maxGap);
+    // Read the key from a file
+    uint64_t getKeyFromFile(uint64_t offset);
+    // Read the vlen from a file
+    uint32_t getVlenFromFile(uint64_t offset);
+    // Read Magic from a file
+    uint8_t getMagicFromFile(uint64_t offset);
+    // Read Checksum from a file
+    uint16_t getChecksumFromFile(uint64_t offset);
+    // Read the entry whose value starts at offset, false on a hole or a broken entry
+    bool readEntry(uint64_t offset, uint64_t &key, std::string &value);
+
+    // Read the vLog from a list
+    void readFromList(const std::list<std::pair<uint64_t, std::string>> &list);
+
+    // Default constructor and destructor
+    vLog(std::string path, int readMode = vlog_read_mode, uint64_t preallocSize = vlog_prealloc_size);
+    ~vLog();
 };
\ No newline at end of file
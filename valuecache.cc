@@ -0,0 +1,116 @@
+#include "valuecache.h"
+
+// Constructor
+ValueCache::ValueCache(uint64_t capacity) {
+    this->shardCapacity = capacity / value_cache_shard_num;
+    this->hits = 0;
+    this->misses = 0;
+}
+
+/****************************************************************************************
+ **                                 Private functions                                  **
+ ****************************************************************************************/
+
+// Shard of an offset
+ValueCache::Shard &ValueCache::getShard(uint64_t offset) {
+    // Offsets of neighbouring values are close, mix the bits before picking
+    uint64_t hash = offset * 0x9E3779B97F4A7C15ULL;
+    return this->shards[(hash >> 32) % value_cache_shard_num];
+}
+
+// Bytes charged for a value
+uint64_t ValueCache::charge(const std::string &value) {
+    return value.size() + sizeof(std::pair<uint64_t, std::string>) + 4 * sizeof(void*);
+}
+
+// Drop the least recently used values until the shard fits
+void ValueCache::evict(Shard &shard) {
+    while (shard.usage > this->shardCapacity && !shard.lru.empty()) {
+        auto &victim = shard.lru.back();
+        shard.usage -= charge(victim.second);
+        shard.table.erase(victim.first);
+        shard.lru.pop_back();
+    }
+}
+
+/****************************************************************************************
+ **                                 Public functions                                   **
+ ****************************************************************************************/
+
+// Get the value at offset, read it from the vLog on a miss
+std::string ValueCache::read(vLog &vlog, uint64_t offset, uint32_t length) {
+    std::string value;
+    if (this->get(offset, value))
+        return value;
+
+    value = vlog.getValFromFile(offset, length);
+
+    // Errors are not cached, the range may become valid later
+    if (value != sstvalue_outOfRange && value != sstvalue_readFile_file)
+        this->put(offset, value);
+    return value;
+}
+
+// Look up the value at offset
+bool ValueCache::get(uint64_t offset, std::string &value) {
+    if (this->shardCapacity == 0)
+        return false;
+
+    Shard &shard = this->getShard(offset);
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto iter = shard.table.find(offset);
+        if (iter != shard.table.end()) {
+            // Move the value to the front
+            shard.lru.splice(shard.lru.begin(), shard.lru, iter->second);
+            value = iter->second->second;
+            this->hits.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    this->misses.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+// Insert the value read at offset
+void ValueCache::put(uint64_t offset, const std::string &value) {
+    // A value larger than the shard would only flush it
+    if (charge(value) > this->shardCapacity)
+        return;
+
+    Shard &shard = this->getShard(offset);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    // Another reader may have inserted it meanwhile, the vLog never changes a value in place
+    if (shard.table.count(offset))
+        return;
+
+    shard.lru.push_front({offset, value});
+    shard.table[offset] = shard.lru.begin();
+    shard.usage += charge(value);
+    this->evict(shard);
+}
+
+// Drop the value at offset
+void ValueCache::erase(uint64_t offset) {
+    Shard &shard = this->getShard(offset);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto iter = shard.table.find(offset);
+    if (iter == shard.table.end())
+        return;
+    shard.usage -= charge(iter->second->second);
+    shard.lru.erase(iter->second);
+    shard.table.erase(iter);
+}
+
+// Drop all the values
+void ValueCache::clear() {
+    for (auto &shard : this->shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.lru.clear();
+        shard.table.clear();
+        shard.usage = 0;
+    }
+}
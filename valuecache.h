@@ -0,0 +1,62 @@
+#pragma once
+#include "config.h"
+#include "vLog.h"
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+/****************************************************************
+    Cache of the values read from the vLog, keyed by their offset
+    The offsets are split into shards, each with its own lock, LRU
+    list and share of the byte budget
+****************************************************************/
+
+class ValueCache {
+private:
+    struct Shard {
+        std::mutex mutex;
+        // Most recently used first, {offset, value}
+        std::list<std::pair<uint64_t, std::string> > lru;
+        std::unordered_map<uint64_t, std::list<std::pair<uint64_t, std::string> >::iterator> table;
+        // Bytes charged for the values in the shard
+        uint64_t usage = 0;
+    };
+    Shard shards[value_cache_shard_num];
+
+    // Bytes each shard may hold
+    uint64_t shardCapacity;
+
+    std::atomic<uint64_t> hits;
+    std::atomic<uint64_t> misses;
+
+    // Shard of an offset
+    Shard &getShard(uint64_t offset);
+    // Bytes charged for a value, including the list and table nodes
+    static uint64_t charge(const std::string &value);
+    // Drop the least recently used values until the shard fits
+    void evict(Shard &shard);
+
+public:
+    // capacity is the byte budget of all the shards, 0 disables the cache
+    ValueCache(uint64_t capacity);
+
+    // Get the value at offset, read it from the vLog on a miss
+    std::string read(vLog &vlog, uint64_t offset, uint32_t length);
+
+    // Look up the value at offset, count a hit or a miss
+    bool get(uint64_t offset, std::string &value);
+    // Insert the value read at offset
+    void put(uint64_t offset, const std::string &value);
+    // Drop the value at offset, e.g. when gc relocates it
+    void erase(uint64_t offset);
+    // Drop all the values, the offsets are reused after a reset
+    void clear();
+
+    // Counters for sizing the cache
+    uint64_t getHits(){return hits.load(std::memory_order_relaxed);};
+    uint64_t getMisses(){return misses.load(std::memory_order_relaxed);};
+};
@@ -0,0 +1,310 @@
+#include "version.h"
+#include <algorithm>
+#include <iterator>
+
+// Constructor
+LevelFiles::LevelFiles(uint64_t level, const LevelFiles* base, const LevelEdit &edit, bool countRuns) {
+    if (base != nullptr) {
+        this->bytes = base->bytes;
+        this->runSizes = base->runSizes;
+    }
+    for (auto &table : edit.removed) {
+        this->bytes -= table.second->getSStableSize();
+        if (countRuns && --this->runSizes[table.second->getSStableTimeStamp()] == 0)
+            this->runSizes.erase(table.second->getSStableTimeStamp());
+    }
+    for (auto &table : edit.added) {
+        this->bytes += table.second->getSStableSize();
+        if (countRuns)
+            this->runSizes[table.second->getSStableTimeStamp()]++;
+    }
+    this->sortedRunNum = this->runSizes.size();
+
+    // A sorted level only rebuilds the chunks the edit touches
+    if (level > 0 && (base == nullptr || base->sstables.empty())) {
+        if (this->editFences(base == nullptr ? LevelFences() : base->fences, edit))
+            return;
+        this->fences = LevelFences();
+    }
+
+    // Otherwise collect all the sstables of the level
+    if (base != nullptr) {
+        this->sstables = base->sstables;
+        for (auto &chunk : base->fences.chunks) {
+            for (const FencePointer &fence : *chunk)
+                this->sstables[fence.fileID] = fence.sstable;
+        }
+    }
+    for (auto &table : edit.removed)
+        this->sstables.erase(table.first);
+    for (auto &table : edit.added)
+        this->sstables[table.first] = table.second;
+    if (level == 0)
+        return;
+
+    // The level is sorted again once its overlapping sstables are merged away
+    std::vector<FencePointer> sorted;
+    for (auto &table : this->sstables)
+        sorted.push_back({table.second->getSStableMinKey(), table.second->getSStableMaxKey(), table.second, table.first});
+    std::sort(sorted.begin(), sorted.end(), [](const FencePointer &a, const FencePointer &b) { return a.minKey < b.minKey; });
+    for (size_t i = 1; i < sorted.size(); i++) {
+        if (sorted[i].minKey <= sorted[i - 1].maxKey)
+            return;
+    }
+    this->appendChunks(sorted);
+    this->sstables.clear();
+}
+
+/****************************************************************************************
+ **                                 Private functions                                  **
+ ****************************************************************************************/
+
+// Apply the edit to the chunks of base
+bool LevelFiles::editFences(const LevelFences &base, const LevelEdit &edit) {
+    auto byMinKey = [](const FencePointer &a, const FencePointer &b) { return a.minKey < b.minKey; };
+    std::vector<FencePointer> added;
+    for (auto &table : edit.added)
+        added.push_back({table.second->getSStableMinKey(), table.second->getSStableMaxKey(), table.second, table.first});
+    std::sort(added.begin(), added.end(), byMinKey);
+
+    // Mark the chunks holding a removed sstable
+    size_t chunkNum = base.chunks.size();
+    std::vector<bool> dirty(chunkNum, false);
+    for (auto &table : edit.removed) {
+        size_t index = Version::seekFence(base, table.second->getSStableMinKey());
+        if (index == base.size() || base.at(index).fileID != table.first)
+            return false;
+        dirty[std::upper_bound(base.starts.begin(), base.starts.end(), index) - base.starts.begin() - 1] = true;
+    }
+
+    // and the chunks an added sstable falls in, the first one whose minKey is not above it
+    for (const FencePointer &fence : added) {
+        auto chunk = std::upper_bound(base.chunks.begin(), base.chunks.end(), fence.minKey,
+            [](uint64_t key, const std::shared_ptr<const FenceChunk> &chunk) { return key < chunk->front().minKey; });
+        if (chunk != base.chunks.begin())
+            chunk--;
+        if (chunk != base.chunks.end())
+            dirty[chunk - base.chunks.begin()] = true;
+    }
+
+    // Keep the clean chunks and rebuild each run of dirty ones with its added sstables
+    std::vector<bool> rebuilt;
+    auto addedIter = added.begin();
+    for (size_t i = 0; i < chunkNum || addedIter != added.end();) {
+        if (i < chunkNum && !dirty[i]) {
+            this->fences.append(base.chunks[i]);
+            rebuilt.push_back(false);
+            i++;
+            continue;
+        }
+
+        std::vector<FencePointer> kept;
+        size_t j = i;
+        for (; j < chunkNum && dirty[j]; j++) {
+            for (const FencePointer &fence : *base.chunks[j]) {
+                if (edit.removed.count(fence.fileID) == 0)
+                    kept.push_back(fence);
+            }
+        }
+        auto addedEnd = (j == chunkNum) ? added.end() : std::lower_bound(addedIter, added.end(),
+            base.chunks[j]->front(), byMinKey);
+
+        std::vector<FencePointer> merged;
+        merged.reserve(kept.size() + (addedEnd - addedIter));
+        std::merge(kept.begin(), kept.end(), addedIter, addedEnd, std::back_inserter(merged), byMinKey);
+        this->appendChunks(merged);
+        rebuilt.resize(this->fences.chunks.size(), true);
+        addedIter = addedEnd;
+        i = j;
+    }
+
+    // The sstables may only overlap where a chunk was rebuilt
+    for (size_t k = 0; k < this->fences.chunks.size(); k++) {
+        const FenceChunk &chunk = *this->fences.chunks[k];
+        if (rebuilt[k]) {
+            for (size_t f = 1; f < chunk.size(); f++) {
+                if (chunk[f].minKey <= chunk[f - 1].maxKey)
+                    return false;
+            }
+        }
+        if (k > 0 && (rebuilt[k] || rebuilt[k - 1]) && chunk.front().minKey <= this->fences.chunks[k - 1]->back().maxKey)
+            return false;
+    }
+    return true;
+}
+
+// Cut sorted fences into chunks appended to the level
+void LevelFiles::appendChunks(std::vector<FencePointer> &fences) {
+    for (size_t i = 0; i < fences.size(); i += version_fence_chunk) {
+        size_t end = std::min<size_t>(i + version_fence_chunk, fences.size());
+        this->fences.append(std::make_shared<const FenceChunk>(fences.begin() + i, fences.begin() + end));
+    }
+}
+
+/****************************************************************************************
+ **                                 Public functions                                   **
+ ****************************************************************************************/
+
+// Fences of the level, nullptr if the level must be searched file by file
+const LevelFences* LevelFiles::getFences() const {
+    if (this->fences.chunks.empty())
+        return nullptr;
+    return &this->fences;
+}
+
+// Add a chunk after the last one
+void LevelFences::append(std::shared_ptr<const FenceChunk> chunk) {
+    if (this->starts.empty())
+        this->starts.push_back(0);
+    this->starts.push_back(this->starts.back() + chunk->size());
+    this->chunks.push_back(chunk);
+}
+
+// Fence at an index of the whole level
+const FencePointer &LevelFences::at(size_t index) const {
+    size_t chunk = std::upper_bound(this->starts.begin(), this->starts.end(), index) - this->starts.begin() - 1;
+    return (*this->chunks[chunk])[index - this->starts[chunk]];
+}
+
+// Constructor
+Version::Version(std::shared_ptr<MemTable> memtable, std::shared_ptr<MemTable> immMemtable, std::shared_ptr<const Levels> levels,
+    std::shared_ptr<vLog> vlog, std::shared_ptr<ValueCache> valueCache) {
+    this->refs = 1;
+    this->memtable = memtable;
+    this->immMemtable = immMemtable;
+    this->levels = levels;
+    this->vlog = vlog;
+    this->valueCache = valueCache;
+}
+
+// Index of the first fence of the level whose maxKey >= key
+size_t Version::seekFence(const LevelFences &fences, uint64_t key) {
+    // The maxKeys are sorted as well since the sstables do not overlap
+    auto chunk = std::lower_bound(fences.chunks.begin(), fences.chunks.end(), key,
+        [](const std::shared_ptr<const FenceChunk> &chunk, uint64_t key) { return chunk->back().maxKey < key; });
+    if (chunk == fences.chunks.end())
+        return fences.size();
+    auto fence = std::lower_bound((*chunk)->begin(), (*chunk)->end(), key,
+        [](const FencePointer &fence, uint64_t key) { return fence.maxKey < key; });
+    return fences.starts[chunk - fences.chunks.begin()] + (fence - (*chunk)->begin());
+}
+
+// The only sstable of the level that may hold the key, nullptr if none
+SStable* Version::findSStable(const LevelFences &fences, uint64_t key) {
+    size_t index = seekFence(fences, key);
+    if (index == fences.size() || fences.at(index).minKey > key)
+        return nullptr;
+    return fences.at(index).sstable.get();
+}
+
+// Constructor
+VersionSet::VersionSet() {
+    this->current = nullptr;
+    this->currentNumber = 0;
+}
+
+// Destructor, no reader may be running
+VersionSet::~VersionSet() {
+    for (int i = 0; i < version_cache_slots; i++) {
+        Version* cached = this->slots[i].version.exchange(nullptr);
+        if (cached != nullptr && !isMarker(cached))
+            unref(cached);
+    }
+    if (this->current != nullptr)
+        unref(this->current);
+}
+
+/****************************************************************************************
+ **                                 Private functions                                  **
+ ****************************************************************************************/
+
+// Slot of the calling thread
+int VersionSet::threadSlot() {
+    static std::atomic<int> nextSlot{0};
+    static thread_local int slot = nextSlot.fetch_add(1) % version_cache_slots;
+    return slot;
+}
+
+// Marks a slot whose version is being used by the calling thread
+Version* VersionSet::threadMarker() {
+    // The low bit is never set in the address of a version
+    static std::atomic<uintptr_t> nextThread{0};
+    static thread_local uintptr_t marker = (nextThread.fetch_add(1) << 1) | 1;
+    return reinterpret_cast<Version*>(marker);
+}
+
+// Take a new reference of the current version
+Version* VersionSet::refCurrent() {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->current->ref();
+    return this->current;
+}
+
+// Drop a reference and delete the version if it is the last one
+void VersionSet::unref(Version* version) {
+    if (version->unref())
+        delete version;
+}
+
+/****************************************************************************************
+ **                                 Public functions                                   **
+ ****************************************************************************************/
+
+// Make a version current
+void VersionSet::install(Version* version) {
+    Version* old = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        old = this->current;
+        version->number = (old == nullptr) ? 1 : old->number + 1;
+        this->current = version;
+        this->currentNumber.store(version->number, std::memory_order_release);
+
+        // Empty every slot, a reader using its slot drops the version itself on release
+        for (int i = 0; i < version_cache_slots; i++) {
+            Version* cached = this->slots[i].version.exchange(nullptr, std::memory_order_acq_rel);
+            if (cached != nullptr && !isMarker(cached))
+                unref(cached);
+        }
+    }
+
+    // Memtables and sstables no other version holds are freed here
+    if (old != nullptr)
+        unref(old);
+}
+
+// Pin the current version
+Version* VersionSet::acquire(int &slot) {
+    slot = threadSlot();
+    Version* marker = threadMarker();
+    Version* version = this->slots[slot].version.load(std::memory_order_acquire);
+
+    // Another reader shares the slot and is using it, take a reference of our own
+    if (isMarker(version) || !this->slots[slot].version.compare_exchange_strong(version, marker, std::memory_order_acq_rel)) {
+        slot = -1;
+        return this->refCurrent();
+    }
+
+    // The slot was emptied by an install, cache the new version in it
+    if (version == nullptr)
+        version = this->refCurrent();
+    return version;
+}
+
+// Pin the current version without a slot
+Version* VersionSet::pin() {
+    return this->refCurrent();
+}
+
+// Unpin a version
+void VersionSet::release(Version* version, int slot) {
+    // Put the version back into the slot unless an install emptied it meanwhile,
+    // a version that is no longer current is dropped instead of cached
+    if (slot >= 0) {
+        Version* expected = threadMarker();
+        Version* cached = (version->number == this->currentNumber.load(std::memory_order_acquire)) ? version : nullptr;
+        if (this->slots[slot].version.compare_exchange_strong(expected, cached, std::memory_order_acq_rel) && cached != nullptr)
+            return;
+    }
+    unref(version);
+}
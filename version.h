@@ -0,0 +1,165 @@
+#pragma once
+#include "config.h"
+#include "memtable.h"
+#include "sstable.h"
+#include "valuecache.h"
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// levelIndex[level][fileID] = sstable
+typedef std::map<uint64_t, std::map<uint64_t, std::shared_ptr<SStable> > > LevelIndex;
+
+// Key range of an sstable
+struct FencePointer {
+    uint64_t minKey;
+    uint64_t maxKey;
+    std::shared_ptr<SStable> sstable;
+    uint64_t fileID;
+};
+
+// A piece of the fences of a level, shared by the levels built from one another until it changes
+typedef std::vector<FencePointer> FenceChunk;
+
+// Fence pointers of a level >= 1 sorted by key, the sstables of the level do not overlap
+class LevelFences {
+public:
+    std::vector<std::shared_ptr<const FenceChunk> > chunks;
+    // starts[i] = index of the first fence of chunks[i], the last one is the number of fences
+    std::vector<size_t> starts;
+
+    size_t size() const {return this->starts.empty() ? 0 : this->starts.back();};
+    const FencePointer &at(size_t index) const;
+    // Add a chunk after the last one
+    void append(std::shared_ptr<const FenceChunk> chunk);
+};
+
+// sstables a flush or a merge adds to and removes from a level, by file id
+struct LevelEdit {
+    std::map<uint64_t, std::shared_ptr<SStable> > added;
+    std::map<uint64_t, std::shared_ptr<SStable> > removed;
+};
+
+/****************************************************************
+    LevelFiles: the sstables of one level and their fences
+    Built once when the level changes and shared by all the
+    versions until it changes again, so that a version only
+    copies the pointers of the levels
+    A sorted level is built from the one it replaces, only the
+    fence chunks holding an edited sstable are copied
+****************************************************************/
+
+class LevelFiles {
+private:
+    // Apply the edit to the chunks of base, false if the sstables overlap afterwards
+    bool editFences(const LevelFences &base, const LevelEdit &edit);
+    // Cut sorted fences into chunks appended to the level
+    void appendChunks(std::vector<FencePointer> &fences);
+
+public:
+    // sstables[fileID] = sstable, of level-0 and of a level whose sstables overlap
+    std::map<uint64_t, std::shared_ptr<SStable> > sstables;
+    // Fences of any other level, they hold its sstables in place of the map
+    LevelFences fences;
+    // Bytes of the sstables in the units of sstable_maxSize, for sizing the level
+    double bytes = 0;
+    // Sorted runs in the level, the sstables of a run share the timestamp of the merge or flush that wrote it
+    uint64_t sortedRunNum = 0;
+    // runSizes[timestamp] = sstables of the run, only counted for the tiered style
+    std::map<uint64_t, uint64_t> runSizes;
+
+    // base is the same level in the last version, nullptr for a new level
+    LevelFiles(uint64_t level, const LevelFiles* base, const LevelEdit &edit, bool countRuns);
+
+    // Fences of the level, nullptr if the level must be searched file by file
+    const LevelFences* getFences() const;
+};
+
+// levels[level] = files of the level, the empty levels are left out
+typedef std::map<uint64_t, std::shared_ptr<const LevelFiles> > Levels;
+
+/****************************************************************
+    Version: what a reader sees of the store at one moment
+    The memtables and the levels are shared with the newer
+    versions, a version never changes after it is installed
+****************************************************************/
+
+class Version {
+private:
+    std::atomic<int> refs;
+
+public:
+    std::shared_ptr<MemTable> memtable;
+    std::shared_ptr<MemTable> immMemtable;
+    // Kept as is by a memtable switch, rebuilt by a flush or a merge
+    std::shared_ptr<const Levels> levels;
+    // The vLog the sstables point into and the cache in front of it, a reset replaces both
+    std::shared_ptr<vLog> vlog;
+    std::shared_ptr<ValueCache> valueCache;
+    // Order of the installs, set by the version set
+    uint64_t number = 0;
+
+    Version(std::shared_ptr<MemTable> memtable, std::shared_ptr<MemTable> immMemtable, std::shared_ptr<const Levels> levels,
+        std::shared_ptr<vLog> vlog, std::shared_ptr<ValueCache> valueCache);
+
+    void ref(){this->refs.fetch_add(1, std::memory_order_relaxed);};
+    // Return true if the last reference is dropped
+    bool unref(){return this->refs.fetch_sub(1, std::memory_order_acq_rel) == 1;};
+
+    // Index of the first fence of the level whose maxKey >= key
+    static size_t seekFence(const LevelFences &fences, uint64_t key);
+    // The only sstable of the level that may hold the key, nullptr if none
+    static SStable* findSStable(const LevelFences &fences, uint64_t key);
+};
+
+/****************************************************************
+    VersionSet: the current version and a cache of it per thread
+    A reader takes the version cached in its slot with one compare
+    and swap and puts it back when done, the lock is only taken
+    when the slot is empty, i.e. once after every install
+    A slot in use holds a marker of the reader's thread, so that
+    a reader sharing the slot after an install cannot be mistaken
+    for the one that marked it before
+****************************************************************/
+
+class VersionSet {
+private:
+    // One cache line per slot, so that readers do not share lines
+    struct alignas(64) Slot {
+        std::atomic<Version*> version{nullptr};
+    };
+    Slot slots[version_cache_slots];
+
+    // The current version holds one reference of its own
+    Version* current;
+    std::atomic<uint64_t> currentNumber;
+    std::mutex mutex;
+
+    // Slot of the calling thread
+    static int threadSlot();
+    // Marks a slot whose version is being used by the calling thread, never a valid version address
+    static Version* threadMarker();
+    static bool isMarker(Version* version){return (reinterpret_cast<uintptr_t>(version) & 1) != 0;};
+    // Take a new reference of the current version
+    Version* refCurrent();
+    // Drop a reference and delete the version if it is the last one
+    static void unref(Version* version);
+
+public:
+    VersionSet();
+    ~VersionSet();
+
+    // Make a version current, the set takes over its first reference
+    void install(Version* version);
+
+    // Pin the current version, slot is passed back to release
+    Version* acquire(int &slot);
+    void release(Version* version, int slot);
+
+    // Pin the current version without a slot, for a reader that lives across calls
+    // and threads such as an iterator, it is released with slot -1
+    Version* pin();
+};
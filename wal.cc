@@ -0,0 +1,291 @@
+#include "wal.h"
+#include "utils.h"
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Length(4Byte) + Checksum(2Byte)
+const size_t wal_recordHeaderSize = 6;
+// Sequence(8Byte)
+const size_t wal_payloadHeaderSize = 8;
+// Type(1Byte) + Key(8Byte) + vlen(4Byte)
+const size_t wal_operationHeaderSize = 13;
+
+// Constructor
+WAL::WAL(std::string path, uint64_t validSize, int syncMode, uint64_t syncIntervalMs){
+    this->path = path;
+    this->syncMode = syncMode;
+    this->syncIntervalMs = syncIntervalMs;
+    this->lastSyncTime = std::chrono::steady_clock::now();
+    this->appendedLSN = 0;
+    this->writtenLSN = 0;
+    this->isWriting = false;
+    this->unsynced = false;
+    this->stopSync = false;
+
+    // Keep one descriptor open for all the appends
+    this->fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if(this->fd < 0){
+        perror("open");
+        return;
+    }
+
+    // Drop the torn tail so that new records follow the valid ones
+    if(ftruncate(this->fd, validSize) < 0)
+        perror("ftruncate");
+
+    // A write skipping its sync must still be synced within about an interval, even if no write follows it
+    if(this->syncMode == wal_sync_interval)
+        this->syncThread = std::thread(&WAL::backgroundSync, this);
+}
+
+// Destructor
+WAL::~WAL(){
+    if(this->fd < 0)
+        return;
+
+    if(this->syncThread.joinable()){
+        {
+            std::unique_lock<std::mutex> lock(this->mutex);
+            this->stopSync = true;
+        }
+        this->syncCond.notify_all();
+        this->syncThread.join();
+    }
+
+    // Nothing appended may be lost on close
+    this->syncAll();
+    close(this->fd);
+}
+
+/****************************************************************************************
+ **                                 Private functions                                  **
+ ****************************************************************************************/
+
+// Write all the bytes to the file
+void WAL::writeAll(const char* data, size_t length){
+    while(length > 0){
+        ssize_t written = write(this->fd, data, length);
+        if(written < 0){
+            perror("write");
+            return;
+        }
+        data += written;
+        length -= written;
+    }
+}
+
+// Sync the file according to the durability mode
+void WAL::syncFile(bool force){
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+    // Skip the sync if the last one is recent enough, the sync thread catches up on it
+    if(!force && this->syncMode == wal_sync_interval
+        && now - this->lastSyncTime < std::chrono::milliseconds(this->syncIntervalMs)){
+        this->unsynced = true;
+        return;
+    }
+
+    // Cleared first, a write skipping its sync meanwhile sets it again
+    this->unsynced = false;
+    fdatasync(this->fd);
+    this->lastSyncTime = now;
+}
+
+// Body of the sync thread
+void WAL::backgroundSync(){
+    std::unique_lock<std::mutex> lock(this->mutex);
+    while(!this->stopSync){
+        this->syncCond.wait_for(lock, std::chrono::milliseconds(this->syncIntervalMs));
+        if(this->stopSync || !this->unsynced.exchange(false))
+            continue;
+
+        // The writers go on while the file is synced
+        lock.unlock();
+        fdatasync(this->fd);
+        lock.lock();
+    }
+}
+
+/****************************************************************************************
+ **                                 Public functions                                   **
+ ****************************************************************************************/
+
+// Append a record, return its end position to wait on
+uint64_t WAL::append(const std::string &payload){
+    // Build the header of the record
+    char header[wal_recordHeaderSize];
+    uint32_t length = payload.size();
+    uint16_t checksum = utils::crc16((const unsigned char*)payload.data(), payload.size());
+    memcpy(header, &length, sizeof(length));
+    memcpy(header + sizeof(length), &checksum, sizeof(checksum));
+
+    std::unique_lock<std::mutex> lock(this->mutex);
+
+    this->pending.append(header, wal_recordHeaderSize);
+    this->pending.append(payload);
+    this->appendedLSN += wal_recordHeaderSize + payload.size();
+
+    // Every write is synced on its own, without waiting for a group
+    if(this->syncMode == wal_sync_write){
+        // Let a running leader finish first to keep the order
+        this->cond.wait(lock, [this]{ return !this->isWriting; });
+
+        this->writeAll(this->pending.data(), this->pending.size());
+        this->syncFile(true);
+        this->pending.clear();
+        this->writtenLSN = this->appendedLSN;
+    }
+
+    return this->appendedLSN;
+}
+
+// Wait until the record ending at lsn is written
+// The first waiter becomes the leader and writes the records of all the waiters at once
+void WAL::sync(uint64_t lsn){
+    std::unique_lock<std::mutex> lock(this->mutex);
+
+    while(this->writtenLSN < lsn){
+        // Follow the running leader
+        if(this->isWriting){
+            this->cond.wait(lock);
+            continue;
+        }
+
+        // Take all the pending records as a group
+        this->isWriting = true;
+        std::string group;
+        group.swap(this->pending);
+        uint64_t groupLSN = this->appendedLSN;
+
+        // Write without blocking the writers appending the next group
+        lock.unlock();
+        this->writeAll(group.data(), group.size());
+        this->syncFile(false);
+        lock.lock();
+
+        this->writtenLSN = groupLSN;
+        this->isWriting = false;
+        this->cond.notify_all();
+    }
+}
+
+// Write and sync all the appended records
+void WAL::syncAll(){
+    uint64_t lsn;
+    {
+        std::unique_lock<std::mutex> lock(this->mutex);
+        lsn = this->appendedLSN;
+    }
+    this->sync(lsn);
+
+    std::unique_lock<std::mutex> lock(this->mutex);
+    this->syncFile(true);
+}
+
+// Move the log file to another path
+void WAL::moveTo(std::string newPath){
+    // The moved log must hold every record
+    this->syncAll();
+
+    // The descriptor still points at the file after renaming
+    std::rename(this->path.c_str(), newPath.c_str());
+    this->path = newPath;
+}
+
+// Drop all the records in the log
+void WAL::reset(){
+    this->syncAll();
+
+    std::unique_lock<std::mutex> lock(this->mutex);
+    if(ftruncate(this->fd, 0) < 0)
+        perror("ftruncate");
+}
+
+// Start a record payload
+void WAL::beginPayload(std::string &payload, uint64_t sequence){
+    payload.append(reinterpret_cast<const char*>(&sequence), sizeof(sequence));
+}
+
+// Add an operation to a record payload
+void WAL::addOperation(std::string &payload, uint8_t type, uint64_t key, const std::string &value){
+    char header[wal_operationHeaderSize];
+    uint32_t vlen = value.size();
+
+    // Type(1Byte) + Key(8Byte) + vlen(4Byte)
+    memcpy(header, &type, sizeof(type));
+    memcpy(header + sizeof(type), &key, sizeof(key));
+    memcpy(header + sizeof(type) + sizeof(key), &vlen, sizeof(vlen));
+
+    payload.append(header, wal_operationHeaderSize);
+    payload.append(value);
+}
+
+// Replay all the valid records of a log, return the size of the valid part
+uint64_t WAL::replay(std::string path, std::function<void(uint8_t, uint64_t, const std::string &, uint64_t)> apply){
+    std::ifstream inFile(path, std::ios::in | std::ios::binary);
+    if(!inFile)
+        return 0;
+
+    // Read the whole log with one sequential read
+    inFile.seekg(0, std::ios::end);
+    uint64_t fileSize = inFile.tellg();
+    inFile.seekg(0, std::ios::beg);
+
+    std::vector<char> buffer(fileSize);
+    inFile.read(buffer.data(), fileSize);
+    inFile.close();
+
+    uint64_t offset = 0;
+    while(offset + wal_recordHeaderSize <= fileSize){
+        uint32_t length;
+        uint16_t checksum;
+        memcpy(&length, buffer.data() + offset, sizeof(length));
+        memcpy(&checksum, buffer.data() + offset + sizeof(length), sizeof(checksum));
+
+        // Stop at a torn record
+        const char* payload = buffer.data() + offset + wal_recordHeaderSize;
+        if(offset + wal_recordHeaderSize + length > fileSize)
+            break;
+        if(utils::crc16((const unsigned char*)payload, length) != checksum)
+            break;
+        if(length < wal_payloadHeaderSize)
+            break;
+
+        // A record whose operations overrun it is corrupt, stop before applying any of them
+        size_t end = wal_payloadHeaderSize;
+        while(end + wal_operationHeaderSize <= length){
+            uint32_t vlen;
+            memcpy(&vlen, payload + end + sizeof(uint8_t) + sizeof(uint64_t), sizeof(vlen));
+            end += wal_operationHeaderSize + vlen;
+        }
+        if(end != length)
+            break;
+
+        // Apply the operations of the record with their own sequence numbers
+        uint64_t sequence;
+        memcpy(&sequence, payload, sizeof(sequence));
+        size_t pos = wal_payloadHeaderSize;
+        while(pos + wal_operationHeaderSize <= length){
+            uint8_t type;
+            uint64_t key;
+            uint32_t vlen;
+            memcpy(&type, payload + pos, sizeof(type));
+            memcpy(&key, payload + pos + sizeof(type), sizeof(key));
+            memcpy(&vlen, payload + pos + sizeof(type) + sizeof(key), sizeof(vlen));
+            pos += wal_operationHeaderSize;
+
+            std::string value(payload + pos, vlen);
+            pos += vlen;
+
+            apply(type, key, value, sequence++);
+        }
+
+        offset += wal_recordHeaderSize + length;
+    }
+
+    return offset;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "config.h"
+#include <cstdint>
+#include <string>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <thread>
+
+/****************************************************************
+    Record: Length(4Byte) + Checksum(2Byte) + Payload
+    Payload: Sequence(8Byte) + a list of operations, the operations
+    take the sequence numbers from Sequence on, since the records
+    of concurrent writers may reach the log out of sequence order
+    Operation: Type(1Byte) + Key(8Byte) + vlen(4Byte) + Value
+****************************************************************/
+
+class WAL {
+private:
+    // Path and file descriptor of the log
+    std::string path;
+    int fd;
+
+    // Durability mode and interval of wal_sync_interval
+    int syncMode;
+    uint64_t syncIntervalMs;
+    std::chrono::steady_clock::time_point lastSyncTime;
+
+    // Records appended but not yet written by a group leader
+    std::string pending;
+    // Bytes appended to the log / bytes already written and synced
+    uint64_t appendedLSN;
+    uint64_t writtenLSN;
+    // Whether a leader is writing a group
+    bool isWriting;
+
+    std::mutex mutex;
+    std::condition_variable cond;
+
+    // Set when a write skipped its sync in wal_sync_interval mode
+    std::atomic<bool> unsynced;
+    // Syncs the skipped writes once an interval has passed, only in wal_sync_interval mode
+    std::thread syncThread;
+    std::condition_variable syncCond;
+    bool stopSync;
+
+    // Write all the bytes to the file
+    void writeAll(const char* data, size_t length);
+    // Sync the file according to the durability mode
+    void syncFile(bool force);
+    // Body of the sync thread
+    void backgroundSync();
+
+public:
+    // Open the log, the bytes after validSize are dropped
+    WAL(std::string path, uint64_t validSize, int syncMode, uint64_t syncIntervalMs);
+    ~WAL();
+
+    // Append a record, return its end position to wait on
+    uint64_t append(const std::string &payload);
+
+    // Wait until the record ending at lsn is written
+    void sync(uint64_t lsn);
+
+    // Write and sync all the appended records
+    void syncAll();
+
+    // Move the log file to another path
+    void moveTo(std::string newPath);
+
+    // Drop all the records in the log
+    void reset();
+
+    // Get the path of the log
+    std::string getPath(){return path;};
+
+    // Start a record payload, its first operation takes the sequence number
+    static void beginPayload(std::string &payload, uint64_t sequence);
+    // Add an operation to a record payload
+    static void addOperation(std::string &payload, uint8_t type, uint64_t key, const std::string &value);
+
+    // Replay all the valid records of a log with the sequence number of each operation,
+    // return the size of the valid part
+    static uint64_t replay(std::string path, std::function<void(uint8_t, uint64_t, const std::string &, uint64_t)> apply);
+};
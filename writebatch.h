@@ -0,0 +1,38 @@
+#pragma once
+#include "config.h"
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+/****************************************************************
+    WriteBatch: puts and dels applied to the store at once
+    The batch is logged as one WAL record, so that recovery
+    replays either all of its operations or none of them
+    The operations take consecutive sequence numbers in the order
+    they were added, a later operation on a key wins
+****************************************************************/
+
+class WriteBatch {
+private:
+    // Key and value of each operation, a del is a put of the tombstone
+    std::vector<std::pair<uint64_t, std::string> > operations;
+
+public:
+    WriteBatch(){};
+    ~WriteBatch(){};
+
+    // Add a put of the key-value pair
+    void put(uint64_t key, const std::string &s) {this->operations.emplace_back(key, s);};
+    // Add a del of the key, the tombstone is written even if the key does not exist
+    void del(uint64_t key) {this->operations.emplace_back(key, delete_tag);};
+    // Drop all the operations
+    void clear() {this->operations.clear();};
+
+    // Number of operations in the batch
+    size_t count() const {return this->operations.size();};
+    bool empty() const {return this->operations.empty();};
+
+    // Operations in the order they were added
+    const std::vector<std::pair<uint64_t, std::string> > &getOperations() const {return this->operations;};
+};
@@ -0,0 +1,280 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include "MurmurHash3.h"
+#include "keyhash.h"
+#include "config.h"
+
+/****************************************************************
+    Xor filter with 8-bit fingerprints (Graf and Lemire)
+    Built once all the keys are known, a key is in the filter if
+    the xor of its 3 slots, one in each third of the table, is
+    its fingerprint: 3 memory accesses and about 9.84 bits per key
+    for a false positive rate of 1/256
+
+    File: Magic(4Byte) + Format(1Byte) + Reserved(3Byte)
+          + Seed(8Byte) + BlockLength(8Byte) + 3 * BlockLength Byte
+****************************************************************/
+
+template <typename K>
+class XorFilter {
+private:
+    static const size_t headerSize = 24;
+    // Seeds tried before the filter gives up and lets every key through
+    static const int maxAttempts = 64;
+
+    uint64_t seed = 0;
+    // Slots in each third of the table
+    uint64_t blockLength = 0;
+    std::vector<uint8_t> fingerprints;
+    // Keys waiting for build
+    std::vector<K> keys;
+
+    // Mix the shared hash of a key with the seed
+    uint64_t mixHash(const KeyHash &keyHash) const;
+    // Slot of a hash in the i-th third
+    uint64_t getSlot(uint64_t hash, int i) const;
+    static uint8_t getFingerprint(uint64_t hash) {return hash ^ (hash >> 32);};
+
+    // Build the table for one seed, false if the keys cannot be peeled
+    bool tryBuild(const std::vector<uint64_t> &hashes);
+
+public:
+    // Add a key, the filter is built from all of them at once
+    void insert(K key);
+    // Build the table from the added keys
+    void build();
+    // Check if a key is in the filter
+    bool find(K key);
+    bool find(const KeyHash &keyHash);
+
+    // Load the filter from a file
+    int readFile(std::string path, uint64_t offset);
+    // Save the filter to a file
+    uint64_t writeToFile(std::string path, uint64_t offset);
+
+    // Bytes of the filter in the file, header included
+    uint64_t getFileSize(){return headerSize + fingerprints.size();};
+    // Bytes of the filter in memory
+    uint64_t getMemoryUsage(){return fingerprints.size();};
+
+    // Constructor
+    XorFilter(uint64_t keyNum){keys.reserve(keyNum);};
+    XorFilter(std::string path, uint64_t offset);
+    // Destructor
+    ~XorFilter(){};
+};
+
+// Parameterized constructor
+template <typename K>
+XorFilter<K>::XorFilter(std::string path, uint64_t offset) {
+    readFile(path, offset);
+}
+
+// Mix the shared hash of a key with the seed
+template <typename K>
+uint64_t XorFilter<K>::mixHash(const KeyHash &keyHash) const {
+    return fmix64(keyHash.hash[0] + seed);
+}
+
+// Slot of a hash in the i-th third
+template <typename K>
+uint64_t XorFilter<K>::getSlot(uint64_t hash, int i) const {
+    // Take a different 32 bits for each third, map them without a division
+    uint32_t part = (i == 0) ? hash : rotl64(hash, 21 * i);
+    return i * blockLength + (((uint64_t)part * blockLength) >> 32);
+}
+
+// Add a key, the filter is built from all of them at once
+template <typename K>
+void XorFilter<K>::insert(K key) {
+    keys.push_back(key);
+}
+
+// Build the table for one seed, false if the keys cannot be peeled
+template <typename K>
+bool XorFilter<K>::tryBuild(const std::vector<uint64_t> &hashes) {
+    uint64_t capacity = 3 * blockLength;
+
+    // Count the keys and xor their hashes in each slot
+    std::vector<uint32_t> count(capacity, 0);
+    std::vector<uint64_t> xorMask(capacity, 0);
+    for (uint64_t hash : hashes) {
+        for (int i = 0; i < 3; i++) {
+            uint64_t slot = getSlot(hash, i);
+            count[slot]++;
+            xorMask[slot] ^= hash;
+        }
+    }
+
+    // Peel the slots holding one key, each one is where its key is assigned
+    std::vector<uint64_t> queue;
+    for (uint64_t slot = 0; slot < capacity; slot++) {
+        if (count[slot] == 1)
+            queue.push_back(slot);
+    }
+
+    std::vector<std::pair<uint64_t, uint64_t> > stack;
+    stack.reserve(hashes.size());
+    while (!queue.empty()) {
+        uint64_t slot = queue.back();
+        queue.pop_back();
+        if (count[slot] != 1)
+            continue;
+
+        uint64_t hash = xorMask[slot];
+        stack.push_back({hash, slot});
+        for (int i = 0; i < 3; i++) {
+            uint64_t other = getSlot(hash, i);
+            count[other]--;
+            xorMask[other] ^= hash;
+            if (count[other] == 1)
+                queue.push_back(other);
+        }
+    }
+
+    if (stack.size() != hashes.size())
+        return false;
+
+    // Assign in reverse peeling order, the slot of a key is the last one set
+    fingerprints.assign(capacity, 0);
+    for (auto iter = stack.rbegin(); iter != stack.rend(); iter++) {
+        uint64_t hash = iter->first;
+        uint8_t fingerprint = getFingerprint(hash);
+        for (int i = 0; i < 3; i++) {
+            uint64_t slot = getSlot(hash, i);
+            if (slot != iter->second)
+                fingerprint ^= fingerprints[slot];
+        }
+        fingerprints[iter->second] = fingerprint;
+    }
+    return true;
+}
+
+// Build the table from the added keys
+template <typename K>
+void XorFilter<K>::build() {
+    // 1.23 slots per key plus a margin for the small tables
+    blockLength = (32 + (keys.size() * 123 + 99) / 100) / 3 + 1;
+
+    std::vector<KeyHash> keyHashes;
+    keyHashes.reserve(keys.size());
+    for (K key : keys)
+        keyHashes.push_back(KeyHash(key));
+
+    std::vector<uint64_t> hashes(keys.size());
+    for (int attempt = 0; attempt < maxAttempts; attempt++) {
+        seed = fmix64(attempt + 1);
+        for (size_t i = 0; i < keyHashes.size(); i++)
+            hashes[i] = mixHash(keyHashes[i]);
+        if (tryBuild(hashes)) {
+            keys.clear();
+            keys.shrink_to_fit();
+            return;
+        }
+    }
+
+    // Duplicate keys never peel, an empty filter lets every key through
+    fingerprints.clear();
+    blockLength = 0;
+    keys.clear();
+    keys.shrink_to_fit();
+}
+
+// Check if a key is in the filter
+template <typename K>
+bool XorFilter<K>::find(K key) {
+    return find(KeyHash(key));
+}
+
+// Check a key hashed by the caller
+template <typename K>
+bool XorFilter<K>::find(const KeyHash &keyHash) {
+    if (fingerprints.empty())
+        return true;
+
+    uint64_t hash = mixHash(keyHash);
+    uint8_t fingerprint = getFingerprint(hash);
+    return fingerprint == (fingerprints[getSlot(hash, 0)] ^ fingerprints[getSlot(hash, 1)]
+        ^ fingerprints[getSlot(hash, 2)]);
+}
+
+// Load the filter from a file
+template <typename K>
+int XorFilter<K>::readFile(std::string path, uint64_t offset) {
+    std::ifstream inFile(path, std::ios::in | std::ios::binary);
+    // Return -1 if the file cannot be opened
+    if (!inFile)
+        return -1;
+
+    inFile.seekg(0, std::ios::end);
+    uint64_t fileLimit = inFile.tellg();
+
+    // Return -2 if the header is out of bounds
+    if (offset + headerSize > fileLimit) {
+        inFile.close();
+        return -2;
+    }
+
+    // Skip the magic and the format, they were checked by the caller
+    inFile.seekg(offset + 8, std::ios::beg);
+    inFile.read((char*)&seed, sizeof(seed));
+    inFile.read((char*)&blockLength, sizeof(blockLength));
+
+    // Return -3 if the table is out of bounds
+    if (offset + headerSize + 3 * blockLength > fileLimit) {
+        blockLength = 0;
+        inFile.close();
+        return -3;
+    }
+
+    fingerprints.resize(3 * blockLength);
+    inFile.read((char*)fingerprints.data(), fingerprints.size());
+    inFile.close();
+    return 0;
+}
+
+// Save the filter to a file
+template <typename K>
+uint64_t XorFilter<K>::writeToFile(std::string path, uint64_t offset) {
+    bool isFileExists = false;
+    std::ifstream inFile(path, std::ios::in | std::ios::binary);
+
+    if (inFile) {
+        isFileExists = true;
+        inFile.close();
+    }
+
+    if (!isFileExists) {
+        offset = 0;
+        // Create a new file
+        std::fstream createFile(path, std::ios::out | std::ios::binary);
+        createFile.close();
+    }
+
+    std::fstream outFile(path, std::ios::out | std::ios::in | std::ios::binary);
+
+    // Return -1 if the file cannot be opened
+    if (!outFile)
+        return -1;
+
+    // Magic(4Byte) + Format(1Byte) + Reserved(3Byte) + Seed(8Byte) + BlockLength(8Byte)
+    char header[headerSize] = {0};
+    uint32_t magic = sstable_filter_magic;
+    uint8_t format = sstable_filter_xor;
+    memcpy(header, &magic, sizeof(magic));
+    memcpy(header + 4, &format, sizeof(format));
+    memcpy(header + 8, &seed, sizeof(seed));
+    memcpy(header + 16, &blockLength, sizeof(blockLength));
+
+    outFile.seekp(offset, std::ios::beg);
+    outFile.write(header, headerSize);
+    outFile.write((char*)fingerprints.data(), fingerprints.size());
+    outFile.close();
+
+    return offset;
+}